@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Micro-benchmark for the window index in clients.c: times client_find()
+ * with a handful of windows and with thousands of them, which should
+ * cost about the same.  Run with "make bench"; needs no X server.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <time.h>
+
+#include "clients.h"
+
+#define BENCH_LOOKUPS 1000000
+
+/* normally defined in xtabs.c */
+volatile sig_atomic_t REDRAW = false;
+volatile sig_atomic_t SIG_QUIT = 0;
+volatile sig_atomic_t SIG_RESTART = 0;
+bool                  REDRAW_ALL = true;
+bool                  EXPOSED = false;
+
+void spawn(char *cmd) { (void)cmd; }
+void spawn_tracked(char *cmd, spawner_cb cb, uint64_t tag)
+{
+   (void)cmd; (void)cb; (void)tag;
+}
+
+/* tab without focusing it, so nothing goes to the X server */
+size_t clients_append(xcb_window_t w);
+
+double
+bench_now()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* nsec per lookup, cycling through the n windows from base */
+double
+bench_lookups(xcb_window_t base, size_t n, size_t *found)
+{
+   double start;
+   size_t i, c;
+
+   *found = 0;
+   start = bench_now();
+   for (i = 0; i < BENCH_LOOKUPS; i++) {
+      if (client_find(base + (i * 7919) % n, &c))
+         (*found)++;
+   }
+   return (bench_now() - start) / BENCH_LOOKUPS;
+}
+
+int
+main()
+{
+   static const size_t   sizes[] = { 5, 5000 };
+   static const xcb_window_t base = 0x1a00001; /* ids are sequential */
+   size_t i, n = 0, found;
+   double hit, miss;
+
+   loop_init(NULL);
+   clients_init();
+
+   for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+      for (; n < sizes[i]; n++)
+         clients_append(base + n);
+
+      hit = bench_lookups(base, n, &found);
+      if (found != BENCH_LOOKUPS)
+         errx(1, "%zd of %d lookups failed", BENCH_LOOKUPS - found, BENCH_LOOKUPS);
+      miss = bench_lookups(base + 0x100000, n, &found);
+      if (found != 0)
+         errx(1, "%zd lookups of missing windows succeeded", found);
+
+      printf("%5zd windows: %6.1f ns/hit %6.1f ns/miss\n", n, hit, miss);
+   }
+   return 0;
+}
@@ -16,97 +16,416 @@
 
 #include "clients.h"
 
+/*
+ * Clients live in a slot map.  Records never move once allocated: removal
+ * puts the slot on a free list and bumps its generation, so a
+ * client_handle (slot + generation) stays valid exactly as long as the
+ * client does.  Fields touched on every lookup and redraw are kept in a
+ * compact "hot" array, apart from the rarely used "cold" strings.
+ *
+ * The tab order is a separate array of slots; everything exported by
+ * the client_* functions below addresses clients by tab position.
+ *
+ * A discarded client (see discard.c) keeps its tab, title and command
+ * but has no window (XCB_NONE) and isn't in the window index until it
+ * is respawned and adopts a new one.
+ */
+
+#define CLIENT_LIVE   0x01
+#define CLIENT_DIRTY  0x02     /* tab needs repainting */
+#define CLIENT_NAMED  0x04     /* has a title */
+#define CLIENT_RESIZE 0x08     /* resize pending until next focused */
+#define CLIENT_MAPPED 0x10     /* window is mapped */
+#define CLIENT_FROZEN 0x20     /* process stopped by suspend.c */
+
+typedef struct {
+   xcb_window_t   window;
+   uint32_t       gen;       /* slot generation, bumped on removal */
+   uint32_t       flags;
+   uint32_t       name_gen;  /* bumped on every title change */
+   int32_t        name_width;
+   size_t         pos;       /* position in the tab order */
+   uint64_t       last_active;  /* loop_now() when last focused/unfocused */
+} client_hot;
+
+/*
+ * Titles change constantly, so each slot owns a title buffer that is
+ * rewritten in place whenever the new title fits and kept when the slot
+ * is recycled.  Commands are interned since most are identical.
+ */
 typedef struct {
    char          *name;
-   char          *command;
+   size_t         name_len;
+   size_t         name_capacity;
+   const char    *command;
+   pid_t          pid;      /* from _NET_WM_PID, 0 if unknown */
+   pid_t          pgid;     /* pid's process group, 0 if unknown */
+} client_cold;
+
+/*
+ * Open-addressing (linear probing) hash index from window id to slot,
+ * so looking up the client of a window doesn't depend on how many tabs
+ * there are.  XCB_NONE marks an empty bucket.
+ */
+typedef struct {
    xcb_window_t   window;
-} client;
+   uint32_t       slot;
+} client_bucket;
 
 struct client_list_t {
-   client  *cs;
-   size_t   capacity;
-   size_t   size;
-   size_t   curr;
-   size_t   offset;
+   client_hot     *hot;
+   client_cold    *cold;
+   size_t          slots;            /* slots ever handed out */
+   size_t          capacity;
+   uint32_t       *free;             /* stack of free slots */
+   size_t          nfree;
+   uint32_t       *order;            /* tab position -> slot */
+   size_t          size;
+   size_t          curr;
+   size_t          offset;
+   client_bucket  *index;
+   size_t          index_capacity;   /* power of two */
+   client_handle   shown;            /* last client client_commit() showed */
+   bool            offset_stale;     /* titles changed the layout */
+   int             commit_timer;
+   bool            commit_pending;
 };
 struct client_list_t clients;
 
 
-client*
-client_geti(size_t c)
+uint32_t
+client_slot(size_t c)
 {
-   if (c > clients.size)
+   if (c >= clients.size)
       errx(1, "%s: index out-of-bounds (%zd,%zd).", __FUNCTION__, c, clients.size);
 
-   return &(clients.cs[c]);
+   return clients.order[c];
+}
+
+client_hot*
+client_geti(size_t c)
+{
+   return &clients.hot[client_slot(c)];
+}
+
+client_cold*
+client_cold_geti(size_t c)
+{
+   return &clients.cold[client_slot(c)];
+}
+
+size_t
+clients_index_hash(xcb_window_t w)
+{
+   /* window ids are sequential per X client, so mix the bits up */
+   return (size_t)((w * 2654435761u) ^ (w >> 16)) & (clients.index_capacity - 1);
+}
+
+client_bucket*
+clients_index_probe(xcb_window_t w)
+{
+   size_t h = clients_index_hash(w);
+
+   while (clients.index[h].window != XCB_NONE && clients.index[h].window != w)
+      h = (h + 1) & (clients.index_capacity - 1);
+
+   return &clients.index[h];
+}
+
+void
+clients_index_resize(size_t new_capacity)
+{
+   client_bucket *old = clients.index;
+   size_t         old_capacity = clients.index_capacity;
+   size_t         i;
+
+   if ((clients.index = calloc(new_capacity, sizeof(client_bucket))) == NULL)
+      err(1, "%s: calloc(3) failed", __FUNCTION__);
+   clients.index_capacity = new_capacity;
+
+   for (i = 0; i < old_capacity; i++) {
+      if (old[i].window != XCB_NONE)
+         *clients_index_probe(old[i].window) = old[i];
+   }
+   free(old);
+}
+
+void
+clients_index_set(xcb_window_t w, uint32_t slot)
+{
+   client_bucket *b;
+
+   /* keep the load factor at or below 1/2 */
+   if (2 * (clients.size + 1) > clients.index_capacity)
+      clients_index_resize(clients.index_capacity * 2);
+
+   b = clients_index_probe(w);
+   b->window = w;
+   b->slot = slot;
 }
 
-client*
-client_getw(xcb_window_t w)
+void
+clients_index_remove(xcb_window_t w)
+{
+   size_t mask = clients.index_capacity - 1;
+   size_t i, j, h;
+
+   i = clients_index_probe(w) - clients.index;
+   if (clients.index[i].window == XCB_NONE)
+      return;
+
+   /* backward-shift deletion: pull later entries of the probe run into
+    * the hole unless that would move them before their home bucket */
+   for (j = (i + 1) & mask; clients.index[j].window != XCB_NONE; j = (j + 1) & mask) {
+      h = clients_index_hash(clients.index[j].window);
+      if (((j - h) & mask) >= ((j - i) & mask)) {
+         clients.index[i] = clients.index[j];
+         i = j;
+      }
+   }
+   clients.index[i].window = XCB_NONE;
+}
+
+void*
+clients_grow(void *p, size_t n, size_t size)
+{
+   if ((p = realloc(p, n * size)) == NULL)
+      err(1, "%s: reallocation failed (%zd).", __FUNCTION__, n);
+
+   return p;
+}
+
+uint32_t
+clients_alloc_slot()
+{
+   size_t new_capacity;
+
+   if (clients.nfree > 0)
+      return clients.free[--clients.nfree];
+
+   if (clients.slots == clients.capacity) {
+      new_capacity = clients.capacity * 2;
+      clients.hot   = clients_grow(clients.hot,   new_capacity, sizeof(client_hot));
+      clients.cold  = clients_grow(clients.cold,  new_capacity, sizeof(client_cold));
+      clients.free  = clients_grow(clients.free,  new_capacity, sizeof(uint32_t));
+      clients.order = clients_grow(clients.order, new_capacity, sizeof(uint32_t));
+      memset(clients.hot + clients.capacity, 0,
+            (new_capacity - clients.capacity) * sizeof(client_hot));
+      memset(clients.cold + clients.capacity, 0,
+            (new_capacity - clients.capacity) * sizeof(client_cold));
+      clients.capacity = new_capacity;
+   }
+
+   return clients.slots++;
+}
+
+/* renumber positions from..size-1 after the tab order changed */
+void
+clients_update_positions(size_t from)
 {
    size_t i;
-   for (i = 0; i < clients.size; i++) {
-      if (client_geti(i)->window == w)
-         return client_geti(i);
+   for (i = from; i < clients.size; i++) {
+      clients.hot[clients.order[i]].pos = i;
+      clients.hot[clients.order[i]].flags |= CLIENT_DIRTY;
    }
-   errx(1, "%s: window not found.", __FUNCTION__);
+}
+
+void
+clients_commit_timeout(void *arg)
+{
+   (void)arg;
+   if (clients.commit_pending)
+      client_commit();
 }
 
 
 void
 clients_init()
 {
-   static const size_t init_size = 100;
+   static const size_t init_size = 64;
 
-   if ((clients.cs = calloc(init_size, sizeof(client))) == NULL)
-      err(1, "%s: calloc(3) failed", __FUNCTION__);
+   clients.hot   = clients_grow(NULL, init_size, sizeof(client_hot));
+   clients.cold  = clients_grow(NULL, init_size, sizeof(client_cold));
+   clients.free  = clients_grow(NULL, init_size, sizeof(uint32_t));
+   clients.order = clients_grow(NULL, init_size, sizeof(uint32_t));
+   memset(clients.hot, 0, init_size * sizeof(client_hot));
+   memset(clients.cold, 0, init_size * sizeof(client_cold));
 
    clients.capacity = init_size;
+   clients.slots = 0;
+   clients.nfree = 0;
    clients.size = 0;
    clients.curr = 0;
    clients.offset = 0;
+
+   clients.index = NULL;
+   clients.index_capacity = 0;
+   clients_index_resize(256);
+
+   clients.shown = 0;
+   clients.offset_stale = false;
+   clients.commit_pending = false;
+   clients.commit_timer = loop_add_timer(clients_commit_timeout, NULL);
 }
 
 void
 clients_free()
 {
-   size_t  i;
-   client *c;
+   size_t       i;
+   client_cold *c;
 
    for (i = 0; i < clients.size; i++) {
-      c = client_geti(i);
-      xevent_send_kill(c->window);
-      if (c->name != NULL) free(c->name);
-      if (c->name != NULL) free(c->command);
+      c = client_cold_geti(i);
+      /* a stopped client can't act on the kill */
+      suspend_thaw(i);
+      suspend_detach(i);
+      if (!client_is_placeholder(i))
+         xevent_send_kill(client_geti(i)->window);
+      intern_release(c->command);
    }
 
-   free(clients.cs);
+   for (i = 0; i < clients.slots; i++)
+      free(clients.cold[i].name);
+
+   free(clients.hot);
+   free(clients.cold);
+   free(clients.free);
+   free(clients.order);
+   free(clients.index);
+   clients.hot = NULL;
+   clients.cold = NULL;
+   clients.free = NULL;
+   clients.order = NULL;
+   clients.index = NULL;
+   clients.index_capacity = 0;
    clients.capacity = 0;
+   clients.slots = 0;
+   clients.nfree = 0;
    clients.size = 0;
    clients.curr = 0;
    clients.offset = 0;
 }
 
+/* first tab whose left edge is at or after strip coordinate x */
+size_t
+clients_tab_at_or_after(int32_t x)
+{
+   size_t c = layout_find(x);
+
+   if (c < clients.size && layout_get_x(c) < x)
+      c++;
+   return c;
+}
+
+/* smallest offset that still fills the bar up to the last tab */
+size_t
+clients_max_offset()
+{
+   int32_t t = layout_get_total() - X.width;
+   return t <= 0 ? 0 : clients_tab_at_or_after(t);
+}
+
+/*
+ * Compute the scroll offset that brings the focused tab into view,
+ * according to X.scroll_policy:
+ *    SCROLL_MINIMAL   scroll as little as possible
+ *    SCROLL_CENTER    keep the focused tab in the middle of the bar
+ * Both are a couple of lookups in the layout's tab edges, no stepping.
+ */
 void
 clients_update_offset()
 {
-   int32_t start, end;
+   size_t  old_offset = clients.offset;
+   int32_t t;
 
-   for (clients.offset = 0;
-        clients.offset < clients.size;
-        clients.offset++) {
-      client_get_xbounds(clients.curr, &start, &end);
-      if (start >= 0 && end <= X.width)
-         return;
+   if (clients.size == 0) {
+      clients.offset = 0;
+      return;
    }
+
+   switch (X.scroll_policy) {
+   case SCROLL_CENTER:
+      t = layout_get_x(clients.curr) + layout_get_width(clients.curr) / 2
+        - X.width / 2;
+      clients.offset = t <= 0 ? 0 : layout_find(t);
+      break;
+   case SCROLL_MINIMAL:
+   default:
+      t = layout_get_x(clients.curr + 1) - X.width;
+      if (clients.curr < clients.offset)
+         clients.offset = clients.curr;
+      else if (t > layout_get_x(clients.offset))
+         clients.offset = clients_tab_at_or_after(t);
+      if (clients.offset > clients.curr)
+         clients.offset = clients.curr;
+      break;
+   }
+
+   if (clients.offset > clients_max_offset())
+      clients.offset = clients_max_offset();
+
+   if (clients.offset != old_offset)
+      REDRAW_ALL = true;
+}
+
+/* bring the focus back into view once titles changed tab widths */
+void
+clients_settle()
+{
+   if (clients.offset_stale && clients.curr < clients.size)
+      clients_update_offset();
+   clients.offset_stale = false;
+}
+
+/* page the bar left (pages < 0) or right without changing focus */
+void
+clients_scroll(int pages)
+{
+   size_t  old_offset = clients.offset;
+   int32_t t;
+
+   if (clients.size == 0)
+      return;
+
+   t = layout_get_x(clients.offset) + pages * X.width;
+   clients.offset = t <= 0 ? 0 : layout_find(t);
+
+   if (clients.offset > clients_max_offset())
+      clients.offset = clients_max_offset();
+
+   if (clients.offset != old_offset) {
+      REDRAW_ALL = true;
+      REDRAW = true;
+   }
+}
+
+/* are there tabs scrolled out of view to the left/right? */
+bool
+clients_hidden_left()
+{
+   return clients.offset > 0;
+}
+
+bool
+clients_hidden_right()
+{
+   return layout_get_total() - layout_get_x(clients.offset) > X.width;
 }
 
+/*
+ * The container changed size.  Only the focused client is resized now;
+ * the others would reflow for every step of an interactive resize, so
+ * they are flagged and resized when they're next focused.
+ */
 void
-clients_resize_all()
+clients_resize_lazy()
 {
    size_t i;
    for (i = 0; i < clients.size; i++)
-      client_resize(i);
+      client_geti(i)->flags |= CLIENT_RESIZE;
+
+   if (clients.size > 0)
+      client_resize(clients.curr);
 }
 
 size_t clients_get_size()  { return clients.size; }
@@ -114,133 +433,420 @@ size_t clients_get_curr()  { return clients.curr; }
 size_t clients_get_offset(){ return clients.offset; }
 
 
+/* new tab at the end, without a window if w is XCB_NONE */
+size_t
+clients_append(xcb_window_t w)
+{
+   client_hot *c;
+   uint32_t    slot;
+
+   slot = clients_alloc_slot();
+   if (w != XCB_NONE)
+      clients_index_set(w, slot);
+
+   c = &clients.hot[slot];
+   c->window     = w;
+   c->gen++;
+   c->flags      = CLIENT_LIVE | CLIENT_DIRTY;
+   c->name_gen   = 0;
+   c->name_width = 0;
+   c->pos        = clients.size;
+   c->last_active = loop_now();
+   clients.cold[slot].name_len = 0;
+   clients.cold[slot].command  = NULL;
+   clients.cold[slot].pid      = 0;
+   clients.cold[slot].pgid     = 0;
+
+   clients.order[clients.size++] = slot;
+   layout_invalidate();
+   return clients.size - 1;
+}
+
+
 size_t
 client_add(xcb_window_t w)
 {
-   size_t  new_capacity;
-   client *new_list;
-   client *c;
+   size_t c = clients_append(w);
 
-   if (clients.size == clients.capacity) {
-      new_capacity = clients.capacity + 50;
-      if ((new_list = realloc(clients.cs, new_capacity)) == NULL)
-         err(1, "%s: reallocation failed (%zd).", __FUNCTION__, new_capacity);
-      clients.capacity = new_capacity;
-      clients.cs = new_list;
-   }
+   session_log_add(c);
+   client_focus(c);
+   return c;
+}
 
-   c = client_geti(clients.size++);
-   c->window  = w;
-   c->name    = NULL;
-   c->command = NULL;
-   client_focus(clients.size - 1);
-   return clients.size - 1;
+/* a tab that is only spawned once focused, see discard_respawn() */
+size_t
+client_add_placeholder(const char *name, const char *command)
+{
+   size_t c = clients_append(XCB_NONE);
+
+   session_log_add(c);
+   if (name != NULL)
+      client_set_name(c, name);
+   if (command != NULL)
+      client_set_command(c, command);
+   return c;
+}
+
+bool
+client_find(xcb_window_t w, size_t *c)
+{
+   client_bucket *b;
+
+   if (w == XCB_NONE)
+      return false;
+
+   b = clients_index_probe(w);
+   if (b->window == XCB_NONE)
+      return false;
+
+   *c = clients.hot[b->slot].pos;
+   return true;
 }
 
 void
 client_remove(xcb_window_t w)
 {
-   size_t i, c = clients.size;
-   for (i = 0; i < clients.size; i++) {
-      if (client_geti(i)->window == w)
-         c = i;
-   }
+   size_t c;
 
-   if (c == clients.size)
+   if (!client_find(w, &c))
       errx(1, "out-o-bounds in remove");
 
-   for (i = c; i < clients.size; i++) {
-      clients.cs[i] = clients.cs[i+1];
-   }
+   client_remove_at(c);
+}
+
+void
+client_remove_at(size_t c)
+{
+   uint32_t slot = client_slot(c);
+
+   session_log_remove(c);
+   tabcache_invalidate(client_get_handle(c));
+   finder_forget(c);
+   clients_index_remove(clients.hot[slot].window);
+
+   intern_release(clients.cold[slot].command);
+   clients.cold[slot].command = NULL;
+   clients.hot[slot].flags = 0;
+   clients.hot[slot].gen++;            /* invalidates outstanding handles */
+   clients.free[clients.nfree++] = slot;
+
+   /* only the small order array shifts, the records stay put */
+   memmove(&clients.order[c], &clients.order[c + 1],
+         (clients.size - c - 1) * sizeof(uint32_t));
    clients.size--;
+   clients_update_positions(c);
+   layout_invalidate();
+
+   if (clients.size == 0) {
+      clients.curr = 0;
+      clients.offset = 0;
+      return;
+   }
 
-   if (c == clients.curr && c > 0) {
+   if (c < clients.curr)
       clients.curr--;
-      client_focus(clients.curr);
+   else if (c == clients.curr)
+      client_focus(c > 0 ? c - 1 : 0);
+
+   clients_update_offset();
+}
+
+/* kill a client, its tab goes once the window is destroyed */
+void
+client_close(size_t c)
+{
+   if (client_is_placeholder(c)) {
+      client_remove_at(c);
+      return;
    }
 
+   suspend_thaw(c);
+   xevent_send_kill(client_get_window(c));
+}
+
+/* move the tab at position from to position to */
+void
+client_move(size_t from, size_t to)
+{
+   uint32_t slot = client_slot(from);
+   size_t   curr_slot = client_slot(clients.curr);
+
+   client_slot(to);
+   if (from < to)
+      memmove(&clients.order[from], &clients.order[from + 1],
+            (to - from) * sizeof(uint32_t));
+   else if (from > to)
+      memmove(&clients.order[to + 1], &clients.order[to],
+            (from - to) * sizeof(uint32_t));
+   clients.order[to] = slot;
+
+   clients_update_positions(from < to ? from : to);
+   layout_invalidate();
+   clients.curr = clients.hot[curr_slot].pos;
+   session_log_move(to);
+   REDRAW = true;
+}
+
+client_handle
+client_get_handle(size_t c)
+{
+   uint32_t slot = client_slot(c);
+   return ((client_handle)clients.hot[slot].gen << 32) | slot;
+}
+
+/* position of the client a handle refers to, false if it's gone */
+bool
+client_from_handle(client_handle h, size_t *c)
+{
+   uint32_t slot = h & 0xffffffff;
+
+   if (slot >= clients.slots
+   ||  !(clients.hot[slot].flags & CLIENT_LIVE)
+   ||  clients.hot[slot].gen != (uint32_t)(h >> 32))
+      return false;
+
+   *c = clients.hot[slot].pos;
+   return true;
 }
 
+/* select only, the focus is committed once the user stops moving */
 void
 client_next(size_t n)
 {
-   clients.curr += n;
-   clients.curr %= clients.size;
-   client_focus(clients.curr);
+   if (clients.size == 0)
+      return;
+
+   client_select((clients.curr + n) % clients.size);
+   client_commit_later();
 }
 
 void
 client_prev(size_t n)
 {
+   if (clients.size == 0)
+      return;
+
    n %= clients.size;
    if (n <= clients.curr)
-      clients.curr -= n;
+      client_select(clients.curr - n);
    else
-      clients.curr = clients.size - n + clients.curr;
-
-   client_focus(clients.curr);
+      client_select(clients.size - n + clients.curr);
+   client_commit_later();
 }
 
 void
 client_resize(size_t c)
 {
+   if (client_is_placeholder(c))
+      return;
+
    xevent_send_resize(client_geti(c)->window);
+   client_geti(c)->flags &= ~CLIENT_RESIZE;
 }
 
+/*
+ * Focusing is split in two: client_select() moves the highlight in the
+ * bar, which is cheap, and client_commit() shows, raises and renames for
+ * the selected client.  Keyboard navigation only selects and lets a
+ * timer commit once the keys (or their autorepeat) stop, so holding a
+ * key doesn't raise every tab on the way.
+ */
 void
 client_focus(size_t c)
 {
-   int32_t start, end;
+   client_select(c);
+   client_commit();
+}
+
+void
+client_commit()
+{
+   size_t c = clients.curr, shown;
+
+   clients.commit_pending = false;
+   if (clients.size == 0)
+      return;
+
+   /* must run before the raise, a stopped client can't repaint */
+   suspend_thaw(c);
+
+   /* with HIDE_UNMAP only the focused client is mapped */
+   if (X.hide_mode == HIDE_UNMAP && client_from_handle(clients.shown, &shown)
+   &&  shown != c)
+      client_hide(shown);
+
+   if (client_is_placeholder(c))
+      discard_respawn(c);
+   else {
+      if (client_geti(c)->flags & CLIENT_RESIZE)
+         client_resize(c);
+
+      client_show(c);
+      xevent_send_raise(client_geti(c)->window);
+   }
+   x_set_window_name(client_get_name(c), X.window);
+   clients.shown = client_get_handle(c);
+}
+
+/* commit once nothing was selected for a little while */
+void
+client_commit_later()
+{
+   static const uint32_t delay = 60;     /* > autorepeat interval */
+
+   clients.commit_pending = true;
+   loop_arm_timer(clients.commit_timer, delay);
+}
+
+void
+client_select(size_t c)
+{
+   uint64_t now = loop_now();
+
+   /* only the old and new focused tabs change, unless we scrolled */
+   if (clients.curr < clients.size) {
+      client_set_dirty(clients.curr);
+      client_geti(clients.curr)->last_active = now;
+   }
+   client_set_dirty(c);
+   client_geti(c)->last_active = now;
 
-   xevent_send_raise(client_geti(c)->window);
-   x_set_window_name(client_geti(c)->name, X.window);
-   client_get_xbounds(c, &start, &end);
    clients.curr = c;
-   if (start < 0 || end > X.width)
-      clients_update_offset();
+   clients_update_offset();
+   session_log_focus(c);
 
    REDRAW = true;
 }
 
+void
+client_show(size_t c)
+{
+   client_hot *h = client_geti(c);
+
+   if (!(h->flags & CLIENT_MAPPED)) {
+      xevent_send_map(h->window);
+      h->flags |= CLIENT_MAPPED;
+   }
+}
+
+void
+client_hide(size_t c)
+{
+   client_hot *h = client_geti(c);
+
+   if (h->flags & CLIENT_MAPPED) {
+      xevent_send_unmap(h->window);
+      h->flags &= ~CLIENT_MAPPED;
+   }
+}
+
+bool
+client_is_mapped(size_t c)
+{
+   return client_geti(c)->flags & CLIENT_MAPPED;
+}
+
 bool
 client_is_focused(size_t c)
 {
    return c == clients.curr;
 }
 
+bool
+client_is_dirty(size_t c)
+{
+   return client_geti(c)->flags & CLIENT_DIRTY;
+}
+
+void
+client_set_dirty(size_t c)
+{
+   client_geti(c)->flags |= CLIENT_DIRTY;
+}
+
+void
+client_clear_dirty(size_t c)
+{
+   client_geti(c)->flags &= ~CLIENT_DIRTY;
+}
+
 void
 client_set_window(size_t c, xcb_window_t w)
 {
+   clients_index_remove(client_geti(c)->window);
+   clients_index_set(w, client_slot(c));
    client_geti(c)->window = w;
 }
 
 void
 client_set_name(size_t i, const char *name)
 {
-   client *c = client_geti(i);
-   if (c->name != NULL)
-      free(c->name);
+   client_set_namen(i, name, strlen(name));
+}
+
+void
+client_set_namen(size_t i, const char *name, size_t len)
+{
+   client_cold *c = client_cold_geti(i);
+   client_hot  *h = client_geti(i);
+   size_t       new_capacity;
+   char        *new_name;
+
+   if (len + 1 > c->name_capacity) {
+      new_capacity = c->name_capacity == 0 ? 64 : c->name_capacity;
+      while (new_capacity < len + 1)
+         new_capacity *= 2;
 
-   if ((c->name = strdup(name)) == NULL)
-      err(1, "%s: strdup failed.", __FUNCTION__);
+      if ((new_name = realloc(c->name, new_capacity)) == NULL)
+         err(1, "%s: reallocation failed (%zd).", __FUNCTION__, new_capacity);
+      c->name = new_name;
+      c->name_capacity = new_capacity;
+   }
+
+   memcpy(c->name, name, len);
+   c->name[len] = '\0';
+   c->name_len = len;
+
+   h->name_width = x_get_strnwidth(c->name, len);
+   h->name_gen++;
+   if (X.tab_layout == LAYOUT_FIT) {
+      /* tab widths changed, which may push the focused tab out of view.
+       * A batch of titles is laid out once, see clients_settle(). */
+      layout_invalidate();
+      clients.offset_stale = true;
+   }
+   h->flags |= CLIENT_NAMED | CLIENT_DIRTY;
+   session_log_title(i);
+   finder_index(i);
 }
 
 void
 client_set_command(size_t i, const char *command)
 {
-   client *c = client_geti(i);
-   if (c->command != NULL)
-      free(c->command);
+   client_set_commandn(i, command, strlen(command));
+}
+
+void
+client_set_commandn(size_t i, const char *command, size_t len)
+{
+   client_cold *c = client_cold_geti(i);
+   const char  *old = c->command;
+
+   c->command = intern(command, len);
+   intern_release(old);
 
-   if ((c->command = strdup(command)) == NULL)
-      err(1, "%s: strdup failed.", __FUNCTION__);
+   /* interned, so unchanged commands compare equal */
+   if (c->command != old) {
+      session_log_command(i);
+      finder_index(i);
+   }
 }
 
 void
 client_get_xbounds(size_t c, int32_t *start, int32_t *end)
 {
-   *start = (c - clients.offset) * X.tab_width;
-   *end   = *start + X.tab_width;
+   *start = layout_get_x(c) - layout_get_x(clients.offset);
+   *end   = *start + layout_get_width(c);
 }
 
 xcb_window_t
@@ -253,15 +859,117 @@ const char *
 client_get_name(size_t c)
 {
    static const char *def = "(no-name)";
-   if (client_geti(c)->name == NULL)
+   if (!(client_geti(c)->flags & CLIENT_NAMED))
       return def;
    else
-      return client_geti(c)->name;
+      return client_cold_geti(c)->name;
+}
+
+bool
+client_is_named(size_t c)
+{
+   return client_geti(c)->flags & CLIENT_NAMED;
+}
+
+size_t
+client_get_name_len(size_t c)
+{
+   if (!(client_geti(c)->flags & CLIENT_NAMED))
+      return strlen(client_get_name(c));
+   else
+      return client_cold_geti(c)->name_len;
+}
+
+int32_t
+client_get_name_width(size_t c)
+{
+   return client_geti(c)->name_width;
+}
+
+uint32_t
+client_get_name_gen(size_t c)
+{
+   return client_geti(c)->name_gen;
 }
 
 const char *
 client_get_command(size_t c)
 {
-   return client_geti(c)->command;
+   return client_cold_geti(c)->command;
+}
+
+
+/* also looks up the process group, which clients may share */
+void
+client_set_pid(size_t c, pid_t pid)
+{
+   client_cold *cold = client_cold_geti(c);
+
+   cold->pid = pid;
+   if (pid == 0 || (cold->pgid = getpgid(pid)) == -1)
+      cold->pgid = 0;
+}
+
+pid_t
+client_get_pid(size_t c)
+{
+   return client_cold_geti(c)->pid;
+}
+
+pid_t
+client_get_pgid(size_t c)
+{
+   return client_cold_geti(c)->pgid;
+}
+
+uint64_t
+client_get_last_active(size_t c)
+{
+   return client_geti(c)->last_active;
+}
+
+bool
+client_is_frozen(size_t c)
+{
+   return client_geti(c)->flags & CLIENT_FROZEN;
 }
 
+void
+client_set_frozen(size_t c, bool frozen)
+{
+   if (frozen)
+      client_geti(c)->flags |= CLIENT_FROZEN;
+   else
+      client_geti(c)->flags &= ~CLIENT_FROZEN;
+}
+
+/*
+ * Kill a client but keep its tab, to be respawned from its command when
+ * focused.  The destroy notify that follows no longer finds it.  Without
+ * kill, the X client the window belongs to is already being killed.
+ */
+void
+client_discard(size_t c, bool kill)
+{
+   client_hot *h = client_geti(c);
+
+   if (client_is_placeholder(c))
+      return;
+
+   suspend_thaw(c);
+   suspend_detach(c);
+   clients_index_remove(h->window);
+   if (kill)
+      xevent_send_kill(h->window);
+
+   h->window = XCB_NONE;
+   h->flags &= ~(CLIENT_MAPPED | CLIENT_RESIZE);
+   client_cold_geti(c)->pid = 0;
+   client_cold_geti(c)->pgid = 0;
+}
+
+bool
+client_is_placeholder(size_t c)
+{
+   return client_geti(c)->window == XCB_NONE;
+}
@@ -18,37 +18,85 @@
 #define CLIENTS_H
 
 #include <xcb/xcb.h>
+#include <sys/types.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <err.h>
 
 #include "events.h"
+#include "intern.h"
+#include "discard.h"
+#include "finder.h"
+#include "layout.h"
+#include "loop.h"
+#include "session.h"
+#include "suspend.h"
+#include "tabcache.h"
 #include "xtabs.h"
 #include "xutil.h"
 
+/* stable reference to a client: slot in the low, generation in the high
+ * 32 bits.  Never 0 for a live client. */
+typedef uint64_t client_handle;
+
 void    clients_init();
 void    clients_free();
 void    clients_update_offset();
-void    clients_resize_all();
+void    clients_settle();
+void    clients_scroll(int pages);
+bool    clients_hidden_left();
+bool    clients_hidden_right();
+void    clients_resize_lazy();
 size_t  clients_get_size();
 size_t  clients_get_curr();
 size_t  clients_get_offset();
 
 size_t  client_add(xcb_window_t w);
+size_t  client_add_placeholder(const char *name, const char *command);
+bool    client_find(xcb_window_t w, size_t *c);
 void    client_remove(xcb_window_t w);
+void    client_remove_at(size_t c);
+void    client_close(size_t c);
+void    client_move(size_t from, size_t to);
 void    client_next(size_t n);
 void    client_prev(size_t n);
 void    client_resize(size_t c);
 void    client_focus(size_t c);
+void    client_select(size_t c);
+void    client_commit();
+void    client_commit_later();
+void    client_show(size_t c);
+void    client_hide(size_t c);
+bool    client_is_mapped(size_t c);
 bool    client_is_focused(size_t c);
+bool    client_is_dirty(size_t c);
+void    client_set_dirty(size_t c);
+void    client_clear_dirty(size_t c);
+bool    client_is_frozen(size_t c);
+void    client_set_frozen(size_t c, bool frozen);
+void    client_discard(size_t c, bool kill);
+bool    client_is_placeholder(size_t c);
 
 void  client_set_window(size_t c, xcb_window_t w);
 void  client_set_name(size_t c, const char *name);
+void  client_set_namen(size_t c, const char *name, size_t len);
 void  client_set_command(size_t c, const char *command);
+void  client_set_commandn(size_t c, const char *command, size_t len);
+void  client_set_pid(size_t c, pid_t pid);
 
 void         client_get_xbounds(size_t c, int32_t *start, int32_t *end);
 xcb_window_t client_get_window(size_t c);
+client_handle client_get_handle(size_t c);
+bool         client_from_handle(client_handle h, size_t *c);
+int32_t      client_get_name_width(size_t c);
 const char*  client_get_name(size_t c);
+size_t       client_get_name_len(size_t c);
+bool         client_is_named(size_t c);
+uint32_t     client_get_name_gen(size_t c);
 const char*  client_get_command(size_t c);
+pid_t        client_get_pid(size_t c);
+pid_t        client_get_pgid(size_t c);
+uint64_t     client_get_last_active(size_t c);
 
 #endif
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Settings file, $HOME/.xtabs/config.  One "key value" pair per line,
+ * blank lines and lines starting with '#' are ignored, e.g.
+ *
+ *    tab_layout     fit
+ *    hide_mode      unmap
+ *    color_curr_fg  #ff8800
+ *    freeze_idle    300
+ *    freeze_allow   mpv
+ *    discard_psi    20
+ *
+ * List settings (freeze_allow, discard_allow, bind) may be repeated.
+ * Unknown keys and bad values are reported and skipped.
+ */
+
+#include "config.h"
+
+settings S = {
+   .restore_jobs = 2,
+   .restore_load = 100,
+};
+
+typedef enum { SET_U16, SET_U32, SET_SIZE, SET_STR, SET_LIST, SET_ENUM } setting_type;
+
+typedef struct {
+   const char    *key;
+   setting_type   type;
+   void          *p;
+   size_t        *n;          /* SET_LIST: element count */
+   const char   **names;      /* SET_ENUM: values, NULL terminated */
+} setting;
+
+static const char *layout_names[] = { "fixed", "fit", "shared", NULL };
+static const char *scroll_names[] = { "minimal", "center", NULL };
+static const char *hide_names[]   = { "raise", "unmap", NULL };
+
+static const setting table[] = {
+   { "tab_width",       SET_U16,  &X.tab_width,        NULL, NULL },
+   { "tab_min_width",   SET_U16,  &X.tab_min_width,    NULL, NULL },
+   { "tab_max_width",   SET_U16,  &X.tab_max_width,    NULL, NULL },
+   { "tab_layout",      SET_ENUM, &X.tab_layout,       NULL, layout_names },
+   { "tab_cache_size",  SET_SIZE, &X.tab_cache_size,   NULL, NULL },
+   { "scroll_policy",   SET_ENUM, &X.scroll_policy,    NULL, scroll_names },
+   { "hide_mode",       SET_ENUM, &X.hide_mode,        NULL, hide_names },
+   { "redraw_interval", SET_U32,  &X.redraw_interval,  NULL, NULL },
+   { "color_norm_fg",   SET_STR,  &X.color_norm_fg,    NULL, NULL },
+   { "color_norm_bg",   SET_STR,  &X.color_norm_bg,    NULL, NULL },
+   { "color_curr_fg",   SET_STR,  &X.color_curr_fg,    NULL, NULL },
+   { "color_curr_bg",   SET_STR,  &X.color_curr_bg,    NULL, NULL },
+   { "color_border",    SET_STR,  &X.color_border,     NULL, NULL },
+   { "freeze_idle",     SET_U32,  &S.freeze_idle,      NULL, NULL },
+   { "freeze_cgroup",   SET_STR,  &S.freeze_cgroup,    NULL, NULL },
+   { "freeze_allow",    SET_LIST, &S.freeze_allow,     &S.nfreeze_allow, NULL },
+   { "discard_psi",     SET_U32,  &S.discard_psi,      NULL, NULL },
+   { "discard_rss",     SET_SIZE, &S.discard_rss,      NULL, NULL },
+   { "discard_allow",   SET_LIST, &S.discard_allow,    &S.ndiscard_allow, NULL },
+   { "restore_jobs",    SET_U32,  &S.restore_jobs,     NULL, NULL },
+   { "restore_load",    SET_U32,  &S.restore_load,     NULL, NULL },
+   { "bind",            SET_LIST, &S.binds,            &S.nbinds, NULL },
+};
+
+
+/* $HOME/.xtabs, where the config and session files live */
+const char*
+config_dir()
+{
+   static char *dir = NULL;
+   const char  *home;
+
+   if (dir != NULL)
+      return dir;
+
+   if ((home = getenv("HOME")) == NULL)
+      home = ".";
+
+   if (asprintf(&dir, "%s/.xtabs", home) == -1)
+      err(1, "%s: asprintf(3) failed", __FUNCTION__);
+
+   return dir;
+}
+
+bool
+config_set(const setting *s, const char *value)
+{
+   char         *end, **list;
+   unsigned long n;
+   size_t        i;
+
+   switch (s->type) {
+   case SET_U16:
+   case SET_U32:
+   case SET_SIZE:
+      /* strtoul(3) takes "", " 1" and "-1", and ULONG_MAX on overflow */
+      if (*value < '0' || *value > '9')
+         return false;
+      errno = 0;
+      n = strtoul(value, &end, 10);
+      if (*end != '\0' || errno == ERANGE
+      || (s->type == SET_U16 && n > UINT16_MAX)
+      || (s->type == SET_U32 && n > UINT32_MAX)
+      || (s->type == SET_SIZE && n > SIZE_MAX))
+         return false;
+      if (s->type == SET_U16)
+         *(uint16_t*)s->p = n;
+      else if (s->type == SET_U32)
+         *(uint32_t*)s->p = n;
+      else
+         *(size_t*)s->p = n;
+      return true;
+
+   case SET_STR:
+      if ((*(char**)s->p = strdup(value)) == NULL)
+         err(1, "%s: strdup failed.", __FUNCTION__);
+      return true;
+
+   case SET_LIST:
+      list = realloc(*(char***)s->p, (*s->n + 1) * sizeof(char*));
+      if (list == NULL)
+         err(1, "%s: reallocation failed (%zd).", __FUNCTION__, *s->n + 1);
+      if ((list[(*s->n)++] = strdup(value)) == NULL)
+         err(1, "%s: strdup failed.", __FUNCTION__);
+      *(char***)s->p = list;
+      return true;
+
+   case SET_ENUM:
+      for (i = 0; s->names[i] != NULL; i++) {
+         if (strcmp(s->names[i], value) == 0) {
+            *(int*)s->p = i;
+            return true;
+         }
+      }
+      return false;
+   }
+   return false;
+}
+
+/* read the config file, on top of the defaults from x_defaults() */
+void
+config_load()
+{
+   FILE   *f;
+   char   *path, line[1024], *key, *value, *end;
+   size_t  i, lineno = 0;
+
+   if (asprintf(&path, "%s/config", config_dir()) == -1)
+      err(1, "%s: asprintf(3) failed", __FUNCTION__);
+
+   if ((f = fopen(path, "r")) == NULL) {
+      free(path);
+      return;
+   }
+
+   while (fgets(line, sizeof(line), f) != NULL) {
+      lineno++;
+      key = line + strspn(line, " \t");
+      if (*key == '#' || *key == '\n' || *key == '\0')
+         continue;
+
+      value = key + strcspn(key, " \t\n");
+      if (*value != '\0')
+         *value++ = '\0';
+      value += strspn(value, " \t");
+      end = value + strlen(value);
+      while (end > value && (end[-1] == '\n' || end[-1] == ' ' || end[-1] == '\t'))
+         *--end = '\0';
+
+      for (i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+         if (strcmp(table[i].key, key) == 0)
+            break;
+      }
+
+      if (i == sizeof(table) / sizeof(table[0]))
+         warnx("%s:%zd: unknown setting '%s'", path, lineno, key);
+      else if (*value == '\0')
+         warnx("%s:%zd: missing value for %s", path, lineno, key);
+      else if (!config_set(&table[i], value))
+         warnx("%s:%zd: bad value '%s' for %s", path, lineno, value, key);
+   }
+
+   fclose(f);
+   free(path);
+}
+
+/* is the basename of the first word of command in list? */
+bool
+config_command_listed(char **list, size_t n, const char *command)
+{
+   const char *base, *p;
+   size_t      len, i;
+
+   if (command == NULL)
+      return false;
+
+   base = command;
+   for (p = command; *p != '\0' && *p != ' '; p++) {
+      if (*p == '/')
+         base = p + 1;
+   }
+   len = p - base;
+
+   for (i = 0; i < n; i++) {
+      if (strlen(list[i]) == len && strncmp(list[i], base, len) == 0)
+         return true;
+   }
+   return false;
+}
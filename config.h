@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "xutil.h"
+
+/* settings that aren't about X (those live in X, see x_defaults()) */
+typedef struct {
+   uint32_t     freeze_idle;      /* secs in background before freezing */
+   char        *freeze_cgroup;    /* delegated cgroup v2 dir, or NULL */
+   char       **freeze_allow;     /* commands that are never frozen */
+   size_t       nfreeze_allow;
+   uint32_t     discard_psi;      /* memory "some" avg10 % that triggers discards */
+   size_t       discard_rss;      /* MiB all clients together may use */
+   char       **discard_allow;    /* commands that are never discarded */
+   size_t       ndiscard_allow;
+   uint32_t     restore_jobs;     /* tabs spawned at once on restore, 0: on focus */
+   uint32_t     restore_load;     /* % load per cpu above which restore waits */
+   char       **binds;            /* "key action [arg]", see keys.c */
+   size_t       nbinds;
+} settings;
+extern settings S;
+
+const char* config_dir();
+void        config_load();
+bool        config_command_listed(char **list, size_t n, const char *command);
+
+#endif
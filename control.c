@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Control socket, $HOME/.xtabs/<session>.sock.  Commands are lines of
+ * text and every command gets one reply line, "ok" or "error <why>";
+ * "list" sends one line per tab before its "ok":
+ *
+ *    <position> <TAB> <window> <TAB> <flags> <TAB> <title> <TAB> <command>
+ *
+ * with flags "f" (focused) and "p" (placeholder), or "-".
+ *
+ *    focus N          next [N]          prev [N]
+ *    move FROM TO     close [N]         spawn [CMD]
+ *    list             save-session
+ *
+ * All complete lines that arrive together are run as one batch: focus
+ * changes only move the selection and the last one is committed at the
+ * end, and the bar is redrawn once after the batch, like after a batch
+ * of X events.  Replies that don't fit the socket are kept and sent as
+ * it drains; only a client that lets more than CONTROL_MAX_OUT pile up
+ * is dropped.
+ * Lines too long for the buffer are answered with an error and skipped.
+ * A client may shut down its end once it's done writing: a last line
+ * without a newline still runs, and the connection closes once all
+ * replies are sent.
+ *
+ * The socket also keeps a second xtabs off a session already running.
+ */
+
+#include "control.h"
+
+#define CONTROL_MAX_LINE 4096
+#define CONTROL_MAX_OUT  (16 * 1024 * 1024)
+
+typedef struct {
+   int      fd;
+   char     buf[CONTROL_MAX_LINE];
+   size_t   len;
+   bool     dropping;               /* the rest of a line too long */
+   bool     closing;                /* at EOF, close once replies are sent */
+   char    *out;                    /* replies not sent yet */
+   size_t   out_sent, out_len, out_capacity;
+} control_conn;
+
+struct control_t {
+   int      fd;
+   char    *path;
+   bool     selected;               /* a command in this batch moved focus */
+};
+struct control_t control = { -1, NULL, false };
+
+
+void
+control_reply(control_conn *c, const char *s)
+{
+   size_t len = strlen(s), new_capacity;
+   char  *new_out;
+
+   if (c->out_len + len + 1 > c->out_capacity) {
+      new_capacity = c->out_capacity == 0 ? 1024 : c->out_capacity;
+      while (new_capacity < c->out_len + len + 1)
+         new_capacity *= 2;
+      if ((new_out = realloc(c->out, new_capacity)) == NULL)
+         err(1, "%s: reallocation failed (%zd).", __FUNCTION__, new_capacity);
+      c->out = new_out;
+      c->out_capacity = new_capacity;
+   }
+
+   memcpy(c->out + c->out_len, s, len);
+   c->out_len += len;
+   c->out[c->out_len++] = '\n';
+}
+
+/* a tab position, false if there's no such tab */
+bool
+control_pos(const char *arg, size_t *pos)
+{
+   char          *end;
+   unsigned long  n;
+
+   if (arg == NULL || *arg == '\0')
+      return false;
+
+   n = strtoul(arg, &end, 10);
+   if (*end != '\0' || n >= clients_get_size())
+      return false;
+
+   *pos = n;
+   return true;
+}
+
+void
+control_list(control_conn *c)
+{
+   char   *line, *p, flags[3], head[64];
+   size_t  i, j, title;
+
+   for (i = 0; i < clients_get_size(); i++) {
+      p = flags;
+      if (client_is_focused(i))
+         *p++ = 'f';
+      if (client_is_placeholder(i))
+         *p++ = 'p';
+      if (p == flags)
+         *p++ = '-';
+      *p = '\0';
+
+      snprintf(head, sizeof(head), "%zu\t%x\t%s\t", i, client_get_window(i), flags);
+      title = strlen(head);
+      if (asprintf(&line, "%s%s\t%s", head, client_get_name(i),
+            client_get_command(i) != NULL ? client_get_command(i) : "") == -1)
+         err(1, "%s: asprintf(3) failed", __FUNCTION__);
+
+      /* keep the fields and lines apart */
+      for (j = title; j < title + client_get_name_len(i); j++) {
+         if (line[j] == '\t')
+            line[j] = ' ';
+      }
+      for (j = 0; line[j] != '\0'; j++) {
+         if (line[j] == '\n')
+            line[j] = ' ';
+      }
+
+      control_reply(c, line);
+      free(line);
+   }
+}
+
+/* run one command, returns the error or NULL */
+const char *
+control_run(control_conn *c, char *line)
+{
+   char   *cmd, *arg, *end;
+   size_t  from, to, n;
+
+   arg = line;
+   cmd = strsep(&arg, " \t");
+   if (arg != NULL)
+      arg += strspn(arg, " \t");
+
+   if (strcmp(cmd, "list") == 0) {
+      control_list(c);
+      return NULL;
+   }
+
+   if (strcmp(cmd, "spawn") == 0) {
+      spawn(arg != NULL && *arg != '\0' ? arg : NULL);
+      return NULL;
+   }
+
+   if (strcmp(cmd, "save-session") == 0) {
+      session_compact();
+      return NULL;
+   }
+
+   if (clients_get_size() == 0)
+      return "no tabs";
+
+   if (strcmp(cmd, "focus") == 0) {
+      if (!control_pos(arg, &to))
+         return "no such tab";
+      client_select(to);
+      control.selected = true;
+      return NULL;
+   }
+
+   if (strcmp(cmd, "next") == 0 || strcmp(cmd, "prev") == 0) {
+      n = 1;
+      if (arg != NULL && *arg != '\0') {
+         if (*arg < '0' || *arg > '9')
+            return "bad count";
+         n = strtoul(arg, &end, 10);
+         if (*end != '\0')
+            return "bad count";
+      }
+      n %= clients_get_size();
+      if (cmd[0] == 'n')
+         client_select((clients_get_curr() + n) % clients_get_size());
+      else
+         client_select((clients_get_curr() + clients_get_size() - n) % clients_get_size());
+      control.selected = true;
+      return NULL;
+   }
+
+   if (strcmp(cmd, "move") == 0) {
+      if (!control_pos(strsep(&arg, " \t"), &from) || !control_pos(arg, &to))
+         return "no such tab";
+      client_move(from, to);
+      return NULL;
+   }
+
+   if (strcmp(cmd, "close") == 0) {
+      if (arg == NULL || *arg == '\0')
+         to = clients_get_curr();
+      else if (!control_pos(arg, &to))
+         return "no such tab";
+      client_close(to);
+      return NULL;
+   }
+
+   return "unknown command";
+}
+
+void
+control_close(control_conn *c)
+{
+   loop_remove_fd(c->fd);
+   close(c->fd);
+   free(c->out);
+   free(c);
+}
+
+/* send what the socket takes, false once done with the client */
+bool
+control_flush(control_conn *c)
+{
+   ssize_t n;
+
+   while (c->out_sent < c->out_len) {
+      n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent,
+            MSG_NOSIGNAL);
+      if (n == -1) {
+         if (errno == EINTR)
+            continue;
+         if (errno != EAGAIN)
+            return false;
+         break;
+      }
+      c->out_sent += n;
+   }
+
+   if (c->out_sent == c->out_len) {
+      c->out_sent = c->out_len = 0;
+      loop_set_fd(c->fd, LOOP_READ);
+      return !c->closing;
+   }
+
+   /* reading, but not keeping up, is fine up to a point */
+   if (c->out_len - c->out_sent > CONTROL_MAX_OUT)
+      return false;
+
+   if (c->out_sent > c->out_capacity / 2) {
+      memmove(c->out, c->out + c->out_sent, c->out_len - c->out_sent);
+      c->out_len -= c->out_sent;
+      c->out_sent = 0;
+   }
+   /* past EOF, readability would only keep reporting it */
+   loop_set_fd(c->fd, c->closing ? LOOP_WRITE : LOOP_READ | LOOP_WRITE);
+   return true;
+}
+
+void
+control_line(control_conn *c, char *line)
+{
+   const char *error;
+   char        reply[128];
+
+   if ((error = control_run(c, line)) == NULL)
+      control_reply(c, "ok");
+   else {
+      snprintf(reply, sizeof(reply), "error %s", error);
+      control_reply(c, reply);
+   }
+}
+
+/*
+ * False if reading failed.  At EOF a last line without its newline is
+ * run too, and the connection closes once the replies are out.
+ */
+bool
+control_read(control_conn *c)
+{
+   char         *line, *end;
+   ssize_t       n;
+
+   if ((n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len)) == -1)
+      return errno == EAGAIN || errno == EINTR;
+   if (n == 0) {
+      /* less than a full buffer is ever left over */
+      c->buf[c->len] = '\0';
+      if (c->len > 0 && c->buf[c->len - 1] == '\r')
+         c->buf[c->len - 1] = '\0';
+      if (!c->dropping && *c->buf != '\0')
+         control_line(c, c->buf);
+      c->len = 0;
+      c->closing = true;
+      return true;
+   }
+   c->len += n;
+
+   /* every complete line is part of this batch */
+   line = c->buf;
+   while ((end = memchr(line, '\n', c->len - (line - c->buf))) != NULL) {
+      *end = '\0';
+      if (end > line && end[-1] == '\r')
+         end[-1] = '\0';
+      if (c->dropping)              /* already answered */
+         c->dropping = false;
+      else if (*line != '\0')
+         control_line(c, line);
+      line = end + 1;
+   }
+
+   c->len -= line - c->buf;
+   memmove(c->buf, line, c->len);
+   if (c->len == sizeof(c->buf)) {
+      c->len = 0;
+      if (!c->dropping)
+         control_reply(c, "error line too long");
+      c->dropping = true;
+   }
+   return true;
+}
+
+void
+control_io(int fd, int ready, void *arg)
+{
+   control_conn *c = arg;
+
+   (void)fd;
+   if ((ready & LOOP_READ) && !c->closing && !control_read(c)) {
+      control_close(c);
+      return;
+   }
+
+   if (control.selected) {
+      client_commit();
+      control.selected = false;
+   }
+
+   if (!control_flush(c))
+      control_close(c);
+}
+
+void
+control_accept(int fd, int ready, void *arg)
+{
+   control_conn *c;
+   int           cfd;
+
+   (void)ready;
+   (void)arg;
+   if ((cfd = accept(fd, NULL, NULL)) == -1)
+      return;
+
+   fcntl(cfd, F_SETFD, FD_CLOEXEC);
+   fcntl(cfd, F_SETFL, O_NONBLOCK);
+
+   if ((c = calloc(1, sizeof(control_conn))) == NULL)
+      err(1, "%s: calloc(3) failed", __FUNCTION__);
+   c->fd = cfd;
+   loop_add_fd(cfd, LOOP_READ, control_io, c);
+}
+
+
+/* whether an xtabs is listening on addr */
+bool
+control_is_running(struct sockaddr_un *addr)
+{
+   bool running;
+   int  fd;
+
+   if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+      err(1, "%s: socket(2) failed", __FUNCTION__);
+
+   running = connect(fd, (struct sockaddr*)addr, sizeof(*addr)) == 0;
+   close(fd);
+   return running;
+}
+
+/* listen on the socket of session name, after loop_init() */
+void
+control_init(const char *name)
+{
+   struct sockaddr_un addr;
+
+   if (asprintf(&control.path, "%s/%s.sock", config_dir(), name) == -1)
+      err(1, "%s: asprintf(3) failed", __FUNCTION__);
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   if (strlen(control.path) >= sizeof(addr.sun_path)) {
+      warnx("%s: '%s' is too long for a socket", __FUNCTION__, control.path);
+      return;
+   }
+   strlcpy(addr.sun_path, control.path, sizeof(addr.sun_path));
+
+   /* two of us would take turns overwriting the session */
+   if (control_is_running(&addr))
+      errx(1, "session '%s' is already running", name);
+
+   if ((control.fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+      err(1, "%s: socket(2) failed", __FUNCTION__);
+   fcntl(control.fd, F_SETFD, FD_CLOEXEC);
+   fcntl(control.fd, F_SETFL, O_NONBLOCK);
+
+   /* left over by an xtabs that didn't exit cleanly */
+   unlink(control.path);
+
+   if (bind(control.fd, (struct sockaddr*)&addr, sizeof(addr)) == -1
+   ||  listen(control.fd, 8) == -1) {
+      warn("%s: can't listen on '%s'", __FUNCTION__, control.path);
+      close(control.fd);
+      control.fd = -1;
+      return;
+   }
+
+   loop_add_fd(control.fd, LOOP_READ, control_accept, NULL);
+}
+
+void
+control_free()
+{
+   if (control.fd != -1) {
+      close(control.fd);
+      unlink(control.path);
+   }
+   free(control.path);
+   control.fd = -1;
+   control.path = NULL;
+}
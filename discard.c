@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Discard tabs under memory pressure.  Every couple of seconds, if the
+ * memory PSI "some avg10" is at least S.discard_psi percent, or the
+ * clients' resident sets add up to more than S.discard_rss MiB, the
+ * least-recently focused clients are killed and left as placeholders
+ * (see client_discard()).  Clients sharing a process, process group or X
+ * connection, directly or through others, go together, and only if all
+ * of them can be restored, i.e. none is focused, allow-listed or without
+ * a command.
+ *
+ * Focusing a placeholder respawns its command.  The spawner reports the
+ * pid it started, and a new window whose _NET_WM_PID is that process, or
+ * one in the session it leads, is given to the placeholder (see
+ * xevent_unpark()).  A respawn that maps nothing within
+ * DISCARD_SPAWN_TTL is forgotten, and focusing the tab tries again.
+ */
+
+#include "discard.h"
+
+#define DISCARD_INTERVAL   2000     /* msec between checks */
+#define DISCARD_HOLDOFF   10000     /* msec for avg10 to notice a discard */
+#define DISCARD_SPAWN_TTL 30000     /* msec a respawn may take to map */
+
+typedef struct {
+   client_handle  client;
+   uint64_t       spawned;          /* loop_now() */
+   pid_t          pid;              /* 0 until the spawner reports it */
+} discard_pending;
+
+struct discard_t {
+   int              timer;
+   uint64_t         last;           /* loop_now() of the last discard */
+   discard_pending *pending;        /* FIFO of placeholders being respawned */
+   size_t           npending;
+   size_t           capacity;
+};
+struct discard_t discard = { -1, 0, NULL, 0, 0 };
+
+/* what a client shares with others, see discard_plan() */
+#define DISCARD_KEY_PID     1ULL
+#define DISCARD_KEY_PGID    2ULL
+#define DISCARD_KEY_XCLIENT 3ULL
+
+typedef struct {
+   uint64_t  key;                   /* DISCARD_KEY_* << 32 | id */
+   size_t    client;
+} discard_key;
+
+/* clients that can only be discarded together */
+typedef struct {
+   size_t    first, n;              /* in plan.members */
+   uint64_t  active;                /* latest loop_now() focus of any */
+   bool      restorable;
+} discard_set;
+
+/* rebuilt by every check, the arrays are kept for the next one */
+struct discard_plan_t {
+   discard_key  *keys;              /* up to 3 per client */
+   size_t       *parent;            /* union-find over clients */
+   size_t       *index;             /* root client -> set */
+   size_t       *rss;               /* set on the first client of a pid */
+   bool         *kill;              /* first client of an X connection */
+   size_t       *members;           /* clients, by set */
+   discard_set  *sets;
+   size_t        nsets;
+   size_t        capacity;          /* clients the arrays hold */
+};
+struct discard_plan_t plan = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, 0 };
+
+
+/* some avg10 of /proc/pressure/memory, -1 if unavailable */
+double
+discard_read_psi()
+{
+   FILE   *f;
+   double  avg10;
+
+   if ((f = fopen("/proc/pressure/memory", "r")) == NULL)
+      return -1;
+
+   if (fscanf(f, "some avg10=%lf", &avg10) != 1)
+      avg10 = -1;
+
+   fclose(f);
+   return avg10;
+}
+
+/* resident set of a process in bytes, 0 if unknown */
+size_t
+discard_read_rss(pid_t pid)
+{
+   FILE   *f;
+   char    path[32];
+   size_t  size, resident;
+
+   snprintf(path, sizeof(path), "/proc/%d/statm", (int)pid);
+   if ((f = fopen(path, "r")) == NULL)
+      return 0;
+
+   if (fscanf(f, "%zu %zu", &size, &resident) != 2)
+      resident = 0;
+
+   fclose(f);
+   return resident * sysconf(_SC_PAGESIZE);
+}
+
+/* forget respawns whose client is gone or that never mapped a window */
+void
+discard_prune()
+{
+   uint64_t now = loop_now();
+   size_t   i, n = 0, c;
+
+   for (i = 0; i < discard.npending; i++) {
+      if (now - discard.pending[i].spawned <= DISCARD_SPAWN_TTL
+      &&  client_from_handle(discard.pending[i].client, &c)
+      &&  client_is_placeholder(c))
+         discard.pending[n++] = discard.pending[i];
+   }
+   discard.npending = n;
+}
+
+bool
+discard_is_pending(client_handle h)
+{
+   size_t i;
+
+   discard_prune();
+   for (i = 0; i < discard.npending; i++) {
+      if (discard.pending[i].client == h)
+         return true;
+   }
+   return false;
+}
+
+/* could c be restored once discarded? */
+bool
+discard_restorable(size_t c)
+{
+   return !client_is_focused(c) && client_get_command(c) != NULL
+       && !config_command_listed(S.discard_allow, S.ndiscard_allow,
+            client_get_command(c));
+}
+
+int
+discard_key_cmp(const void *a, const void *b)
+{
+   uint64_t x = ((const discard_key*)a)->key, y = ((const discard_key*)b)->key;
+
+   return x < y ? -1 : x > y;
+}
+
+int
+discard_set_cmp(const void *a, const void *b)
+{
+   uint64_t x = ((const discard_set*)a)->active, y = ((const discard_set*)b)->active;
+
+   return x < y ? -1 : x > y;
+}
+
+size_t
+discard_find(size_t c)
+{
+   while (plan.parent[c] != c)
+      c = plan.parent[c] = plan.parent[plan.parent[c]];
+   return c;
+}
+
+void
+discard_plan_grow(size_t n)
+{
+   size_t capacity = plan.capacity == 0 ? 64 : plan.capacity;
+
+   while (capacity < n)
+      capacity *= 2;
+
+   if ((plan.keys    = realloc(plan.keys,    3 * capacity * sizeof(discard_key))) == NULL
+   ||  (plan.parent  = realloc(plan.parent,  capacity * sizeof(size_t))) == NULL
+   ||  (plan.index   = realloc(plan.index,   capacity * sizeof(size_t))) == NULL
+   ||  (plan.rss     = realloc(plan.rss,     capacity * sizeof(size_t))) == NULL
+   ||  (plan.kill    = realloc(plan.kill,    capacity * sizeof(bool))) == NULL
+   ||  (plan.members = realloc(plan.members, capacity * sizeof(size_t))) == NULL
+   ||  (plan.sets    = realloc(plan.sets,    capacity * sizeof(discard_set))) == NULL)
+      err(1, "%s: reallocation failed (%zd).", __FUNCTION__, capacity);
+   plan.capacity = capacity;
+}
+
+/*
+ * Split the clients into sets that can only be discarded together, in
+ * one sort of their pids, process groups and X connections.  A set is
+ * as recent as its most recently focused client, and only sets of
+ * restorable clients are kept, least recently focused first.  With rss,
+ * returns the resident memory of all clients' processes, each counted
+ * once.
+ */
+size_t
+discard_plan(bool rss)
+{
+   discard_key *k;
+   discard_set *s;
+   size_t       c, i, n = clients_get_size(), nkeys = 0, first, total = 0;
+
+   if (n > plan.capacity)
+      discard_plan_grow(n);
+
+   for (c = 0; c < n; c++) {
+      plan.parent[c] = c;
+      plan.rss[c] = 0;
+      plan.kill[c] = false;
+      if (client_is_placeholder(c))
+         continue;
+
+      if (client_get_pid(c) != 0) {
+         k = &plan.keys[nkeys++];
+         k->key = DISCARD_KEY_PID << 32 | (uint32_t)client_get_pid(c);
+         k->client = c;
+      }
+      if (client_get_pgid(c) != 0) {
+         k = &plan.keys[nkeys++];
+         k->key = DISCARD_KEY_PGID << 32 | (uint32_t)client_get_pgid(c);
+         k->client = c;
+      }
+      k = &plan.keys[nkeys++];
+      k->key = DISCARD_KEY_XCLIENT << 32 | x_client_id(client_get_window(c));
+      k->client = c;
+   }
+
+   /* clients with the same key end up next to each other */
+   qsort(plan.keys, nkeys, sizeof(discard_key), discard_key_cmp);
+   for (i = 0; i < nkeys; i++) {
+      k = &plan.keys[i];
+      if (i > 0 && k->key == k[-1].key) {
+         plan.parent[discard_find(k->client)] = discard_find(k[-1].client);
+         continue;
+      }
+      if (k->key >> 32 == DISCARD_KEY_PID && rss)
+         total += plan.rss[k->client] = discard_read_rss((pid_t)(uint32_t)k->key);
+      else if (k->key >> 32 == DISCARD_KEY_XCLIENT)
+         plan.kill[k->client] = true;
+   }
+
+   plan.nsets = 0;
+   for (c = 0; c < n; c++) {
+      if (client_is_placeholder(c) || discard_find(c) != c)
+         continue;
+      plan.index[c] = plan.nsets;
+      s = &plan.sets[plan.nsets++];
+      s->first = s->n = 0;
+      s->active = 0;
+      s->restorable = true;
+   }
+   for (c = 0; c < n; c++) {
+      if (client_is_placeholder(c))
+         continue;
+      s = &plan.sets[plan.index[discard_find(c)]];
+      s->n++;
+      if (client_get_last_active(c) > s->active)
+         s->active = client_get_last_active(c);
+      if (!discard_restorable(c))
+         s->restorable = false;
+   }
+
+   for (first = 0, i = 0; i < plan.nsets; i++) {
+      plan.sets[i].first = first;
+      first += plan.sets[i].n;
+      plan.sets[i].n = 0;
+   }
+   for (c = 0; c < n; c++) {
+      if (client_is_placeholder(c))
+         continue;
+      s = &plan.sets[plan.index[discard_find(c)]];
+      plan.members[s->first + s->n++] = c;
+   }
+
+   for (n = 0, i = 0; i < plan.nsets; i++) {
+      if (plan.sets[i].restorable)
+         plan.sets[n++] = plan.sets[i];
+   }
+   plan.nsets = n;
+   qsort(plan.sets, plan.nsets, sizeof(discard_set), discard_set_cmp);
+
+   return total;
+}
+
+/*
+ * Turn every client of a set into a placeholder, killing each X
+ * connection once.  Returns the resident memory the set's processes had.
+ */
+size_t
+discard_set_discard(const discard_set *s)
+{
+   size_t i, c, freed = 0;
+
+   for (i = s->first; i < s->first + s->n; i++) {
+      c = plan.members[i];
+      freed += plan.rss[c];
+      if (plan.kill[c])
+         xevent_send_kill(client_get_window(c));
+   }
+
+   for (i = s->first; i < s->first + s->n; i++) {
+      c = plan.members[i];
+      client_discard(c, false);
+      client_set_dirty(c);
+   }
+
+   discard.last = loop_now();
+   REDRAW = true;
+   return freed;
+}
+
+void
+discard_check(void *arg)
+{
+   size_t   i, freed, rss;
+   double   psi;
+
+   (void)arg;
+   loop_arm_timer(discard.timer, DISCARD_INTERVAL);
+
+   if (S.discard_rss > 0) {
+      rss = discard_plan(true);
+
+      /* the freed memory is known right away, so catch up in one go */
+      for (i = 0; i < plan.nsets && rss > S.discard_rss * 1024 * 1024; i++) {
+         freed = discard_set_discard(&plan.sets[i]);
+         rss -= freed < rss ? freed : rss;
+      }
+   }
+
+   if (S.discard_psi > 0 && loop_now() - discard.last >= DISCARD_HOLDOFF) {
+      psi = discard_read_psi();
+      if (psi >= S.discard_psi) {
+         discard_plan(false);
+         if (plan.nsets > 0)
+            discard_set_discard(&plan.sets[0]);
+      }
+   }
+}
+
+/* does nothing unless discard_psi or discard_rss is set */
+void
+discard_init()
+{
+   if (S.discard_psi == 0 && S.discard_rss == 0)
+      return;
+
+   discard.timer = loop_add_timer(discard_check, NULL);
+   loop_arm_timer(discard.timer, DISCARD_INTERVAL);
+}
+
+void
+discard_free()
+{
+   free(plan.keys);
+   free(plan.parent);
+   free(plan.index);
+   free(plan.rss);
+   free(plan.kill);
+   free(plan.members);
+   free(plan.sets);
+   memset(&plan, 0, sizeof(plan));
+
+   free(discard.pending);
+   discard.pending = NULL;
+   discard.npending = 0;
+   discard.capacity = 0;
+}
+
+/* spawn a placeholder's command, unless that's already under way */
+void
+discard_respawn(size_t c)
+{
+   discard_pending *new_pending;
+   client_handle    h = client_get_handle(c);
+   size_t           new_capacity;
+
+   if (discard_is_pending(h) || client_get_command(c) == NULL)
+      return;
+
+   if (discard.npending == discard.capacity) {
+      new_capacity = discard.capacity == 0 ? 8 : discard.capacity * 2;
+      new_pending = realloc(discard.pending, new_capacity * sizeof(discard_pending));
+      if (new_pending == NULL)
+         err(1, "%s: reallocation failed (%zd).", __FUNCTION__, new_capacity);
+      discard.pending = new_pending;
+      discard.capacity = new_capacity;
+   }
+
+   discard.pending[discard.npending].client  = h;
+   discard.pending[discard.npending].spawned = loop_now();
+   discard.pending[discard.npending].pid     = 0;
+   discard.npending++;
+
+   /* spawn() wants a mutable string */
+   spawn_tracked((char*)client_get_command(c), discard_spawned, h);
+}
+
+/* spawner callback, tag is the placeholder's handle */
+void
+discard_spawned(uint64_t tag, pid_t pid)
+{
+   size_t i;
+
+   for (i = 0; i < discard.npending; i++) {
+      if (discard.pending[i].client == tag) {
+         discard.pending[i].pid = pid;
+         return;
+      }
+   }
+}
+
+/* respawns still waiting for their window */
+size_t
+discard_pending_count()
+{
+   discard_prune();
+   return discard.npending;
+}
+
+/*
+ * Hand a new window to the placeholder whose respawn started the
+ * process with the window's pid, or the session that process leads (for
+ * commands that fork).  False if no placeholder wants the window.
+ */
+bool
+discard_adopt(xcb_window_t w, pid_t pid, size_t *c)
+{
+   pid_t  sid;
+   size_t i;
+
+   discard_prune();
+   if (pid == 0)
+      return false;
+
+   sid = getsid(pid);
+   for (i = 0; i < discard.npending; i++) {
+      if (discard.pending[i].pid != 0
+      && (discard.pending[i].pid == pid || discard.pending[i].pid == sid))
+         break;
+   }
+   if (i == discard.npending || !client_from_handle(discard.pending[i].client, c))
+      return false;
+
+   memmove(discard.pending + i, discard.pending + i + 1,
+         (discard.npending - i - 1) * sizeof(discard_pending));
+   discard.npending--;
+
+   client_set_window(*c, w);
+   return true;
+}
@@ -16,28 +16,154 @@
 
 #include "events.h"
 
-bool
-rectangle_contains(int rx, int ry, int rw, int rh, int x, int y)
+/*
+ * Events are handled in batches: everything queued on the connection is
+ * drained before the bar is redrawn.  Work that is redundant within a
+ * batch is collected here and done once in xevent_flush_batch().
+ */
+typedef struct {
+   xcb_window_t               window;
+   xcb_atom_t                 atom;
+   xcb_get_property_cookie_t  cookie;
+   xcb_get_text_property_reply_t reply;
+   uint32_t                   pid;      /* for _NET_WM_PID */
+   xcb_get_property_cookie_t  machine;  /* WM_CLIENT_MACHINE, with the pid */
+   bool                       ok;
+} property_change;
+
+struct xevent_batch_t {
+   bool                          configure;
+   xcb_configure_notify_event_t  last_configure;
+   property_change              *props;
+   size_t                        nprops;
+   size_t                        capacity;
+   size_t                        done;     /* props already collected */
+};
+struct xevent_batch_t batch;
+
+/*
+ * While placeholders are being respawned, new windows get no tab until
+ * their _NET_WM_PID tells whether they belong to one of them.  Windows
+ * that don't say within XEVENT_PARK_TTL get a tab of their own.
+ */
+#define XEVENT_PARK_TTL 1000     /* msec */
+
+typedef struct {
+   xcb_window_t   window;
+   uint64_t       since;         /* loop_now() */
+} parked_window;
+
+struct xevent_parked_t {
+   parked_window *windows;
+   size_t         size;
+   size_t         capacity;
+   int            timer;
+};
+struct xevent_parked_t parked = { NULL, 0, 0, -1 };
+
+
+void
+xevent_dispatch(xcb_generic_event_t *e)
+{
+   switch (e->response_type & ~0x80) {
+   case XCB_EXPOSE:
+      EXPOSED = true;
+      REDRAW = true;
+      break;
+   case XCB_KEY_PRESS:
+      xevent_recv_keypress((xcb_key_press_event_t*)e);
+      break;
+   case XCB_MAPPING_NOTIFY:
+      keys_mapping_notify((xcb_mapping_notify_event_t*)e);
+      break;
+   case XCB_BUTTON_PRESS:
+      xevent_recv_buttonpress((xcb_button_press_event_t*)e);
+      break;
+   case XCB_CONFIGURE_NOTIFY:
+      /* only the final geometry matters */
+      if (((xcb_configure_notify_event_t*)e)->window == X.window) {
+         batch.last_configure = *(xcb_configure_notify_event_t*)e;
+         batch.configure = true;
+      }
+      break;
+   case XCB_CREATE_NOTIFY:
+      xevent_recv_create_notify((xcb_create_notify_event_t*)e);
+      break;
+   case XCB_DESTROY_NOTIFY:
+      xevent_recv_destroy_notify((xcb_destroy_notify_event_t*)e);
+      break;
+   case XCB_PROPERTY_NOTIFY:
+      xevent_recv_property_notify((xcb_property_notify_event_t*)e);
+      break;
+   }
+}
+
+void
+xevent_flush_batch()
 {
-   return (rx <= x && x <= rx + rw) && (ry <= y && y <= ry + rh);
+   size_t i, n;
+
+   if (batch.configure) {
+      xevent_recv_configure_notify(&batch.last_configure);
+      batch.configure = false;
+   }
+
+   /* all requests went out as the notifies arrived, so collecting the
+    * replies costs about one round trip no matter how many there are */
+   n = batch.nprops;
+   for (i = 0; i < n; i++) {
+      if (batch.props[i].atom == X.atom_net_wm_pid) {
+         batch.props[i].ok = x_get_pid_reply(batch.props[i].cookie,
+               &batch.props[i].pid);
+         if (!xevent_machine_is_local(batch.props[i].machine))
+            batch.props[i].ok = false;
+      } else
+         batch.props[i].ok = x_get_text_property_reply(batch.props[i].cookie,
+               &batch.props[i].reply);
+   }
+
+   /* handling them may queue more, those are for the next batch */
+   batch.done = n;
+   for (i = 0; i < n; i++) {
+      if (!batch.props[i].ok)
+         continue;
+
+      if (batch.props[i].atom == X.atom_net_wm_pid)
+         xevent_update_pid(batch.props[i].window, batch.props[i].pid);
+      else {
+         xevent_update_property(batch.props[i].window, batch.props[i].atom,
+               batch.props[i].reply.name, batch.props[i].reply.name_len);
+         xcb_get_text_property_reply_wipe(&batch.props[i].reply);
+      }
+   }
+
+   batch.nprops -= n;
+   memmove(batch.props, batch.props + n, batch.nprops * sizeof(property_change));
+   batch.done = 0;
 }
 
 void
 xevent_recv_buttonpress(xcb_button_press_event_t *e)
 {
    size_t i;
-   int    rx,ry,rw,rh;
 
    if ((int)e->event_y > (int)X.bar_height)
       return;
 
-   for (i = clients_get_offset(); i < clients_get_size(); i++) {
-      rx = i * X.tab_width;   ry = 0;
-      rw = X.tab_width;       rh = X.bar_height;
-      if (rectangle_contains(rx,ry,rw,rh,e->event_x,e->event_y))
-         client_focus(i);
+   /* wheel pages through the tabs */
+   switch (e->detail) {
+   case 4:
+      clients_scroll(-1);
+      return;
+   case 5:
+      clients_scroll(1);
+      return;
    }
 
+   i = layout_find(layout_get_x(clients_get_offset()) + e->event_x);
+   if (i < clients_get_size())
+      client_focus(i);
+
    /* TODO: figure out why e->state is always 0.
     * TODO: eventually, right-click should close a window.
     * TODO: also remove hideous casting above
@@ -48,14 +174,26 @@ void
 xevent_recv_configure_notify(xcb_configure_notify_event_t *e)
 {
    if (e->window == X.window) {
+      /* a move, nothing to do */
+      if (e->width == X.width && e->height == X.height)
+         return;
+
       X.width  = e->width;
       X.height = e->height;
 
-      xcb_free_pixmap(X.connection, X.bar);
-      xcb_create_pixmap(X.connection, X.screen->root_depth, X.bar,
-         X.window, X.width, X.height);
+      /* the bar pixmap is as wide as the screen, so it's only ever
+       * recreated if the window grows beyond that */
+      if (X.width > X.bar_width) {
+         xcb_free_pixmap(X.connection, X.bar);
+         xcb_create_pixmap(X.connection, X.screen->root_depth, X.bar,
+            X.window, X.width, X.bar_height);
+         X.bar_width = X.width;
+      }
 
-      clients_resize_all();
+      clients_resize_lazy();
+      layout_invalidate();
+      clients_update_offset();
+      REDRAW_ALL = true;
       REDRAW = true;
    }
 }
@@ -68,89 +206,224 @@ xevent_recv_create_notify(xcb_create_notify_event_t *e)
    size_t   c;
 
    if (e->window != X.window) {
+      /* client_add() focuses, and so maps, the new client */
       xcb_unmap_window(X.connection, e->window);
       xcb_reparent_window(X.connection, e->window, X.window, 0, X.bar_height);
-      xcb_map_window(X.connection, e->window);
       xcb_change_window_attributes(X.connection, e->window, mask, values);
 
-      c = client_add(e->window);
-      client_resize(c);
+      if (discard_pending_count() > 0)
+         xevent_park(e->window);
+      else {
+         c = client_add(e->window);
+         client_resize(c);
+      }
+      xevent_queue_property(e->window, X.atom_net_wm_pid);
       REDRAW = true;
    }
 }
 
+/* hold w back until its pid is known, see xevent_unpark() */
+void
+xevent_park(xcb_window_t w)
+{
+   parked_window *new_windows;
+   size_t         new_capacity;
+
+   if (parked.size == parked.capacity) {
+      new_capacity = parked.capacity == 0 ? 8 : parked.capacity * 2;
+      new_windows = realloc(parked.windows, new_capacity * sizeof(parked_window));
+      if (new_windows == NULL)
+         err(1, "%s: reallocation failed (%zd).", __FUNCTION__, new_capacity);
+      parked.windows = new_windows;
+      parked.capacity = new_capacity;
+   }
+   parked.windows[parked.size].window = w;
+   parked.windows[parked.size].since  = loop_now();
+   parked.size++;
+
+   if (parked.timer == -1)
+      parked.timer = loop_add_timer(xevent_park_timeout, NULL);
+   if (!loop_timer_armed(parked.timer))
+      loop_arm_timer(parked.timer, XEVENT_PARK_TTL);
+}
+
+/* forget a parked window, false if w isn't one */
+bool
+xevent_forget_parked(xcb_window_t w)
+{
+   size_t i;
+
+   for (i = 0; i < parked.size; i++) {
+      if (parked.windows[i].window == w) {
+         parked.windows[i] = parked.windows[--parked.size];
+         return true;
+      }
+   }
+   return false;
+}
+
+/*
+ * Give a parked window to the placeholder that respawned it (a
+ * respawned placeholder keeps its place and only shows if focused), or
+ * a tab of its own.  Its title and command may have been set while it
+ * was parked, so they're fetched again.
+ */
+void
+xevent_unpark(xcb_window_t w, pid_t pid)
+{
+   size_t c;
+
+   if (!xevent_forget_parked(w))
+      return;
+
+   if (discard_adopt(w, pid, &c)) {
+      client_resize(c);
+      if (client_is_focused(c))
+         client_focus(c);
+   } else {
+      c = client_add(w);
+      client_resize(c);
+   }
+
+   xevent_queue_property(w, WM_NAME);
+   xevent_queue_property(w, WM_COMMAND);
+   REDRAW = true;
+}
+
+void
+xevent_park_timeout(void *arg)
+{
+   uint64_t now = loop_now(), oldest = now;
+   size_t   i = 0;
+
+   (void)arg;
+   while (i < parked.size) {
+      if (now - parked.windows[i].since >= XEVENT_PARK_TTL)
+         xevent_unpark(parked.windows[i].window, 0);
+      else {
+         if (parked.windows[i].since < oldest)
+            oldest = parked.windows[i].since;
+         i++;
+      }
+   }
+
+   if (parked.size > 0)
+      loop_arm_timer(parked.timer, XEVENT_PARK_TTL - (now - oldest));
+}
+
 void
 xevent_recv_destroy_notify(xcb_destroy_notify_event_t *e)
 {
+   size_t c;
+
+   if (xevent_forget_parked(e->window))
+      return;
+
+   /* discarded clients have been forgotten already */
+   if (!client_find(e->window, &c))
+      return;
+
+   suspend_detach(c);
    client_remove(e->window);
-   session_save();
    REDRAW = true;
 }
 
 void
 xevent_recv_keypress(xcb_key_press_event_t *e)
 {
-   /* TODO Still need to figure out keysym's in xcb. */
-   const char *MODIFIERS[] = {
-      "Shift", "Lock", "Ctrl", "Alt",
-      "Mod2", "Mod3", "Mod4", "Mod5",
-      "Button1", "Button2", "Button3", "Button4", "Button5"
-   };
-   uint32_t mask = e->state;
-   size_t i;
+   keys_dispatch(e->detail, e->state);
+}
+
+void
+xevent_recv_property_notify(xcb_property_notify_event_t *e)
+{
+   if (X.window == e->window)
+      return;
+
+   if (e->atom == WM_NAME || e->atom == WM_COMMAND || e->atom == X.atom_net_wm_pid)
+      xevent_queue_property(e->window, e->atom);
+}
+
+xcb_get_property_cookie_t
+xevent_request_property(xcb_window_t w, xcb_atom_t atom)
+{
+   if (atom == X.atom_net_wm_pid)
+      return x_request_pid(w);
+   else
+      return x_request_text_property(w, atom);
+}
+
+/* send the request now, the reply is collected in xevent_flush_batch() */
+void
+xevent_queue_property(xcb_window_t w, xcb_atom_t atom)
+{
+   property_change *new_props;
+   size_t           i, new_capacity;
 
-   printf("k->detail = %d [%c]   Modifier: ", e->detail, e->detail);
-   for (i = 0; i < 13 && mask; mask >>= 1, i++) {
-      if (mask & 1) {
-         printf("%s", MODIFIERS[i]);
+   /* several changes of the same property cost one fetch: the reply to an
+    * earlier request might predate this change, so replace it */
+   for (i = batch.done; i < batch.nprops; i++) {
+      if (batch.props[i].window == w && batch.props[i].atom == atom) {
+         xcb_discard_reply(X.connection, batch.props[i].cookie.sequence);
+         batch.props[i].cookie = xevent_request_property(w, atom);
+         if (atom == X.atom_net_wm_pid) {
+            xcb_discard_reply(X.connection, batch.props[i].machine.sequence);
+            batch.props[i].machine = x_request_text_property(w, WM_CLIENT_MACHINE);
+         }
+         return;
       }
    }
-   printf ("\n");
-   /* XXX end test code */
 
-
-   switch (e->detail) {
-   case 43: /* 'h' */
-   case 44: /* 'j' */
-      client_prev(1);
-      REDRAW = true;
-      break;
-   case 45: /* 'k' */
-   case 46: /* 'l' */
-      client_next(1);
-      REDRAW = true;
-      break;
-   case 53: /* 'x' */
-      SIG_QUIT = 1;
-      break;
-   case 57: /* 'n' */
-      spawn(NULL);
-      break;
-   case 25: /* 'w' */
-      session_save();
-      break;
+   if (batch.nprops == batch.capacity) {
+      new_capacity = batch.capacity == 0 ? 16 : batch.capacity * 2;
+      new_props = realloc(batch.props, new_capacity * sizeof(property_change));
+      if (new_props == NULL)
+         err(1, "%s: reallocation failed (%zd).", __FUNCTION__, new_capacity);
+      batch.props = new_props;
+      batch.capacity = new_capacity;
    }
+
+   batch.props[batch.nprops].window = w;
+   batch.props[batch.nprops].atom   = atom;
+   batch.props[batch.nprops].cookie = xevent_request_property(w, atom);
+   /* a pid is only any use if it's on this host */
+   if (atom == X.atom_net_wm_pid)
+      batch.props[batch.nprops].machine =
+         x_request_text_property(w, WM_CLIENT_MACHINE);
+   batch.nprops++;
+}
+
+/* without WM_CLIENT_MACHINE there's no telling, assume it's local */
+bool
+xevent_machine_is_local(xcb_get_property_cookie_t c)
+{
+   xcb_get_text_property_reply_t reply;
+   bool                          local;
+
+   if (!x_get_text_property_reply(c, &reply))
+      return true;
+
+   local = reply.name_len == 0 || x_is_local_host(reply.name, reply.name_len);
+   xcb_get_text_property_reply_wipe(&reply);
+   return local;
 }
 
 void
-xevent_recv_property_notify(xcb_property_notify_event_t *e)
+xevent_update_property(xcb_window_t w, xcb_atom_t atom, const char *value,
+      size_t len)
 {
-   size_t i, c = 0;
+   size_t c;
 
-   if (X.window == e->window || (e->atom != WM_NAME && e->atom != WM_COMMAND))
+   /* the window may have been destroyed later in the batch */
+   if (!client_find(w, &c))
       return;
 
-   for (i = 0; i < clients_get_size(); i++) {
-      if (client_get_window(i) == e->window)
-         c = i;
-   }
-
    /* Each if block after this should check for an atom type and return within
     * the block
     */
 
-   if (e->atom == WM_NAME) {
-      client_set_name(c, x_get_window_name(e->window));
+   if (atom == WM_NAME) {
+      client_set_namen(c, value, len);
       if (client_is_focused(c))
          x_set_window_name(client_get_name(c), X.window);
 
@@ -158,13 +431,27 @@ xevent_recv_property_notify(xcb_property_notify_event_t *e)
       return;
    }
    
-   if (e->atom == WM_COMMAND) {
-      client_set_command(c, x_get_command(e->window));
-      session_save();
+   if (atom == WM_COMMAND) {
+      client_set_commandn(c, value, len);
       return;
    }
 }
 
+void
+xevent_update_pid(xcb_window_t w, uint32_t pid)
+{
+   size_t c;
+
+   xevent_unpark(w, pid);
+   if (!client_find(w, &c) || client_get_pid(c) == (pid_t)pid)
+      return;
+
+   client_set_pid(c, pid);
+   suspend_attach(c);
+   suspend_adopt(c);
+   REDRAW = true;                /* for export.c */
+}
+
 void
 xevent_send_kill(xcb_window_t w)
 {
@@ -182,6 +469,18 @@ xevent_send_kill(xcb_window_t w)
    /* All generate BadWindow errors from vimprobable2.  FML */
 }
 
+void
+xevent_send_map(xcb_window_t w)
+{
+   xcb_map_window(X.connection, w);
+}
+
+void
+xevent_send_unmap(xcb_window_t w)
+{
+   xcb_unmap_window(X.connection, w);
+}
+
 void
 xevent_send_raise(xcb_window_t w)
 {
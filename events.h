@@ -20,19 +20,37 @@
 #include <xcb/xcb.h>
 #include <err.h>
 
+#include "discard.h"
+#include "keys.h"
 #include "session.h"
+#include "suspend.h"
 #include "clients.h"
 #include "xtabs.h"
 #include "xutil.h"
 
+void xevent_dispatch(xcb_generic_event_t *e);
+void xevent_flush_batch();
+
 void xevent_recv_buttonpress(xcb_button_press_event_t *e);
 void xevent_recv_configure_notify(xcb_configure_notify_event_t *e);
 void xevent_recv_create_notify(xcb_create_notify_event_t *e);
+void xevent_park(xcb_window_t w);
+bool xevent_forget_parked(xcb_window_t w);
+void xevent_unpark(xcb_window_t w, pid_t pid);
+void xevent_park_timeout(void *arg);
 void xevent_recv_destroy_notify(xcb_destroy_notify_event_t *e);
 void xevent_recv_keypress(xcb_key_press_event_t *e);
 void xevent_recv_property_notify(xcb_property_notify_event_t *e);
+xcb_get_property_cookie_t xevent_request_property(xcb_window_t w, xcb_atom_t atom);
+void xevent_queue_property(xcb_window_t w, xcb_atom_t atom);
+bool xevent_machine_is_local(xcb_get_property_cookie_t c);
+void xevent_update_pid(xcb_window_t w, uint32_t pid);
+void xevent_update_property(xcb_window_t w, xcb_atom_t atom, const char *value,
+      size_t len);
 
 void xevent_send_kill(xcb_window_t w);
+void xevent_send_map(xcb_window_t w);
+void xevent_send_unmap(xcb_window_t w);
 void xevent_send_raise(xcb_window_t w);
 void xevent_send_resize(xcb_window_t w);
 
@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The tab list, published in a shared file for status bars and scripts:
+ * $XDG_RUNTIME_DIR/xtabs-<session>.state (or in $HOME/.xtabs without
+ * $XDG_RUNTIME_DIR).  Readers mmap it and read a consistent snapshot
+ * without any syscalls or X traffic, using the seqlock in the header:
+ *
+ *    do {
+ *       s = h->seq;              (retry while odd)
+ *       ... copy header and entries ...
+ *    } while (s & 1 || h->seq != s);
+ *
+ * If capacity grew past what they mapped they need to map again.  The
+ * generation is also written with pwrite(2), so inotify (IN_MODIFY) or
+ * polling it tells readers when to look.
+ *
+ * export_update() runs along with the bar redraw and only rewrites the
+ * entries that changed.
+ */
+
+/* O_CLOEXEC, ftruncate(2) and pwrite(2) are POSIX, asprintf(3) BSD/GNU */
+#define _GNU_SOURCE
+
+#include "export.h"
+
+/* what an entry was last written from */
+typedef struct {
+   client_handle  client;
+   uint32_t       name_gen;
+   uint32_t       window;
+   int32_t        pid;
+   uint32_t       flags;
+} export_shadow;
+
+struct export_t {
+   int             fd;
+   char           *path;
+   export_header  *header;
+   size_t          map_size;
+   export_shadow  *shadow;
+   size_t          nshadow;
+};
+struct export_t export = { -1, NULL, NULL, 0, NULL, 0 };
+
+
+size_t
+export_file_size(size_t capacity)
+{
+   return sizeof(export_header) + capacity * sizeof(export_entry);
+}
+
+/* grow file, mapping and shadow to hold n entries, under the seqlock */
+void
+export_reserve(size_t n)
+{
+   export_shadow *new_shadow;
+   size_t         capacity = export.header->capacity;
+   void          *map;
+
+   if (n <= capacity)
+      return;
+
+   while (capacity < n)
+      capacity *= 2;
+
+   if (ftruncate(export.fd, export_file_size(capacity)) == -1)
+      err(1, "%s: ftruncate(2) failed", __FUNCTION__);
+
+   map = mmap(NULL, export_file_size(capacity), PROT_READ | PROT_WRITE,
+         MAP_SHARED, export.fd, 0);
+   if (map == MAP_FAILED)
+      err(1, "%s: mmap(2) failed", __FUNCTION__);
+   munmap(export.header, export.map_size);
+   export.header = map;
+   export.map_size = export_file_size(capacity);
+   export.header->capacity = capacity;
+
+   if ((new_shadow = realloc(export.shadow, capacity * sizeof(export_shadow))) == NULL)
+      err(1, "%s: reallocation failed (%zd).", __FUNCTION__, capacity);
+   memset(new_shadow + export.nshadow, 0, (capacity - export.nshadow) * sizeof(export_shadow));
+   export.shadow = new_shadow;
+   export.nshadow = capacity;
+}
+
+uint32_t
+export_flags(size_t c)
+{
+   uint32_t flags = 0;
+
+   if (client_is_focused(c))
+      flags |= EXPORT_FOCUSED;
+   if (client_is_placeholder(c))
+      flags |= EXPORT_PLACEHOLDER;
+   if (client_is_frozen(c))
+      flags |= EXPORT_FROZEN;
+   return flags;
+}
+
+bool
+export_changed(size_t c)
+{
+   export_shadow *s = &export.shadow[c];
+
+   return s->client   != client_get_handle(c)
+       || s->name_gen != client_get_name_gen(c)
+       || s->window   != client_get_window(c)
+       || s->pid      != client_get_pid(c)
+       || s->flags    != export_flags(c);
+}
+
+void
+export_write_entry(size_t c)
+{
+   export_entry  *e = (export_entry*)(export.header + 1) + c;
+   export_shadow *s = &export.shadow[c];
+   size_t         len = client_get_name_len(c);
+
+   if (len >= EXPORT_TITLE_MAX)
+      len = EXPORT_TITLE_MAX - 1;
+
+   s->client   = client_get_handle(c);
+   s->name_gen = client_get_name_gen(c);
+   s->window   = client_get_window(c);
+   s->pid      = client_get_pid(c);
+   s->flags    = export_flags(c);
+
+   e->window    = s->window;
+   e->pid       = s->pid;
+   e->flags     = s->flags;
+   e->title_len = len;
+   memcpy(e->title, client_get_name(c), len);
+   e->title[len] = '\0';
+}
+
+
+/* publish the state of session name, does nothing if that fails */
+void
+export_init(const char *name)
+{
+   const char *dir;
+
+   if ((dir = getenv("XDG_RUNTIME_DIR")) != NULL) {
+      if (asprintf(&export.path, "%s/xtabs-%s.state", dir, name) == -1)
+         err(1, "%s: asprintf(3) failed", __FUNCTION__);
+   } else if (asprintf(&export.path, "%s/%s.state", config_dir(), name) == -1)
+      err(1, "%s: asprintf(3) failed", __FUNCTION__);
+
+   if ((export.fd = open(export.path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) == -1) {
+      warn("%s: failed to create '%s'", __FUNCTION__, export.path);
+      return;
+   }
+
+   export.map_size = export_file_size(64);
+   if (ftruncate(export.fd, export.map_size) == -1)
+      err(1, "%s: ftruncate(2) failed", __FUNCTION__);
+
+   export.header = mmap(NULL, export.map_size, PROT_READ | PROT_WRITE,
+         MAP_SHARED, export.fd, 0);
+   if (export.header == MAP_FAILED)
+      err(1, "%s: mmap(2) failed", __FUNCTION__);
+
+   memcpy(export.header->magic, EXPORT_MAGIC, sizeof(export.header->magic));
+   export.header->capacity = 64;
+   export.header->entry_size = sizeof(export_entry);
+
+   if ((export.shadow = calloc(64, sizeof(export_shadow))) == NULL)
+      err(1, "%s: calloc(3) failed", __FUNCTION__);
+   export.nshadow = 64;
+
+   export_update();
+}
+
+void
+export_free()
+{
+   if (export.header != NULL)
+      munmap(export.header, export.map_size);
+   if (export.fd != -1) {
+      close(export.fd);
+      unlink(export.path);
+   }
+   free(export.path);
+   free(export.shadow);
+   memset(&export, 0, sizeof(export));
+   export.fd = -1;
+}
+
+void
+export_update()
+{
+   export_header *h = export.header;
+   size_t         c, n = clients_get_size();
+   bool           changed;
+
+   if (h == NULL)
+      return;
+
+   changed = h->count != n
+          || (n > 0 && h->focused != clients_get_curr())
+          || (n == 0 && h->focused != 0);
+   for (c = 0; !changed && c < n; c++)
+      changed = export_changed(c);
+   if (!changed)
+      return;
+
+   h->seq++;
+   __sync_synchronize();
+
+   export_reserve(n);
+   h = export.header;
+   for (c = 0; c < n; c++) {
+      if (export_changed(c))
+         export_write_entry(c);
+   }
+   h->count = n;
+   h->focused = n > 0 ? clients_get_curr() : 0;
+   h->generation++;
+
+   __sync_synchronize();
+   h->seq++;
+
+   /* the mapping already has it, this is for inotify */
+   if (pwrite(export.fd, &h->generation, sizeof(h->generation),
+         offsetof(export_header, generation)) == -1)
+      warn("%s: pwrite(2) failed", __FUNCTION__);
+}
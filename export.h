@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "clients.h"
+#include "config.h"
+
+#define EXPORT_MAGIC      "xtabs01"
+#define EXPORT_TITLE_MAX  240
+
+#define EXPORT_FOCUSED     0x1
+#define EXPORT_PLACEHOLDER 0x2
+#define EXPORT_FROZEN      0x4
+
+/* the file starts with the header, entries follow in tab order */
+typedef struct {
+   char              magic[8];
+   volatile uint32_t seq;           /* odd while being written */
+   uint32_t          capacity;      /* entries the file has room for */
+   uint64_t          generation;    /* bumped with every change */
+   uint32_t          count;
+   uint32_t          focused;       /* position, 0 if there are no tabs */
+   uint32_t          entry_size;
+   uint32_t          pad[9];
+} export_header;
+
+typedef struct {
+   uint32_t  window;
+   int32_t   pid;                   /* 0 if unknown */
+   uint32_t  flags;
+   uint32_t  title_len;
+   char      title[EXPORT_TITLE_MAX];   /* '\0' terminated */
+} export_entry;
+
+void export_init(const char *name);
+void export_free();
+void export_update();
+
+#endif
@@ -0,0 +1,622 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Quick switching to a tab by typing part of its title or command.  The
+ * finder takes over the bar and the keyboard: typing filters the tabs,
+ * Up/Down (or Tab/Shift+Tab) pick one, Return focuses it and Escape
+ * goes back.
+ *
+ * Titles and commands are indexed by their trigrams (each run of three
+ * bytes within a word, lowercased, see finder_grams()).  A hash table
+ * maps every trigram to the slots of the clients containing it, and a
+ * client's entry is updated in place whenever its title or command
+ * changes, by diffing its old and new sets of trigrams.
+ *
+ * A query is split into trigrams the same way, and only their posting
+ * lists are read to count how many of them each tab has.  A tab matches
+ * if it has at least half of them (all of them for very short queries),
+ * so a typo doesn't lose it.  Tabs with every trigram come first, and
+ * within that the most recently focused ones.
+ */
+
+#include "finder.h"
+
+#define FINDER_QUERY_MAX  128
+#define FINDER_RESULTS    32     /* best matches kept, enough for the bar */
+
+/* tabs containing a trigram, unordered; gram 0 marks an empty bucket */
+typedef struct {
+   uint32_t   gram;
+   uint32_t  *slots;
+   uint32_t   size;
+   uint32_t   capacity;
+} finder_posting;
+
+/* what is indexed for the client in a slot */
+typedef struct {
+   client_handle  client;
+   uint32_t      *grams;         /* sorted */
+   uint32_t       ngrams;
+   uint32_t       capacity;
+} finder_doc;
+
+struct finder_t {
+   finder_posting *table;
+   size_t          table_capacity;  /* power of two */
+   size_t          table_size;
+   finder_doc     *docs;            /* by client slot */
+   uint16_t       *hits;            /* by client slot, zero between queries */
+   uint32_t       *touched;         /* slots with hits */
+   size_t          ndocs;
+   uint32_t       *scratch;
+   size_t          nscratch;
+   size_t          scratch_capacity;
+
+   bool            active;
+   bool            stale;           /* query or index changed since run */
+   char            query[FINDER_QUERY_MAX];
+   size_t          query_len;
+   client_handle   results[FINDER_RESULTS];
+   uint64_t        ranks[FINDER_RESULTS];
+   size_t          nresults;
+   size_t          nmatches;
+   size_t          selected;
+   size_t          first;           /* first result shown in the bar */
+};
+struct finder_t finder;
+
+
+void*
+finder_grow(void *p, size_t n, size_t size)
+{
+   if ((p = realloc(p, n * size)) == NULL)
+      err(1, "%s: reallocation failed (%zd).", __FUNCTION__, n);
+
+   return p;
+}
+
+size_t
+finder_hash(uint32_t gram)
+{
+   return (size_t)(gram * 2654435761u) & (finder.table_capacity - 1);
+}
+
+finder_posting*
+finder_probe(uint32_t gram)
+{
+   size_t h = finder_hash(gram);
+
+   while (finder.table[h].gram != 0 && finder.table[h].gram != gram)
+      h = (h + 1) & (finder.table_capacity - 1);
+
+   return &finder.table[h];
+}
+
+void
+finder_table_resize(size_t new_capacity)
+{
+   finder_posting *old = finder.table;
+   size_t          old_capacity = finder.table_capacity;
+   size_t          i;
+
+   if ((finder.table = calloc(new_capacity, sizeof(finder_posting))) == NULL)
+      err(1, "%s: calloc(3) failed", __FUNCTION__);
+   finder.table_capacity = new_capacity;
+
+   for (i = 0; i < old_capacity; i++) {
+      if (old[i].gram != 0)
+         *finder_probe(old[i].gram) = old[i];
+   }
+   free(old);
+}
+
+void
+finder_posting_add(uint32_t gram, uint32_t slot)
+{
+   finder_posting *p = finder_probe(gram);
+
+   /* empty lists are kept, so buckets are never freed */
+   if (p->gram == 0) {
+      if (2 * (finder.table_size + 1) > finder.table_capacity) {
+         finder_table_resize(finder.table_capacity * 2);
+         p = finder_probe(gram);
+      }
+      p->gram = gram;
+      finder.table_size++;
+   }
+
+   if (p->size == p->capacity) {
+      p->capacity = p->capacity == 0 ? 4 : p->capacity * 2;
+      p->slots = finder_grow(p->slots, p->capacity, sizeof(uint32_t));
+   }
+   p->slots[p->size++] = slot;
+}
+
+void
+finder_posting_remove(uint32_t gram, uint32_t slot)
+{
+   finder_posting *p = finder_probe(gram);
+   uint32_t        i;
+
+   for (i = 0; i < p->size; i++) {
+      if (p->slots[i] == slot) {
+         p->slots[i] = p->slots[--p->size];
+         return;
+      }
+   }
+}
+
+/* make room for client slots 0..n-1 */
+void
+finder_reserve(size_t n)
+{
+   size_t new_ndocs = finder.ndocs;
+
+   if (n <= finder.ndocs)
+      return;
+
+   while (new_ndocs < n)
+      new_ndocs *= 2;
+
+   finder.docs    = finder_grow(finder.docs, new_ndocs, sizeof(finder_doc));
+   finder.hits    = finder_grow(finder.hits, new_ndocs, sizeof(uint16_t));
+   finder.touched = finder_grow(finder.touched, new_ndocs, sizeof(uint32_t));
+   memset(finder.docs + finder.ndocs, 0,
+         (new_ndocs - finder.ndocs) * sizeof(finder_doc));
+   memset(finder.hits + finder.ndocs, 0,
+         (new_ndocs - finder.ndocs) * sizeof(uint16_t));
+   finder.ndocs = new_ndocs;
+}
+
+void
+finder_push(uint32_t gram)
+{
+   if (finder.nscratch == finder.scratch_capacity) {
+      finder.scratch_capacity *= 2;
+      finder.scratch = finder_grow(finder.scratch, finder.scratch_capacity,
+            sizeof(uint32_t));
+   }
+   finder.scratch[finder.nscratch++] = gram;
+}
+
+/*
+ * Append the trigrams of s to the scratch array.  Words are padded as
+ * "  word ", which gives short words trigrams and makes the start of a
+ * word count for more.  If open is set the last word is left unpadded
+ * at the end, as it's still being typed.
+ */
+void
+finder_grams(const char *s, size_t len, bool open)
+{
+   uint32_t gram = 0;
+   bool     word = false;
+   size_t   i;
+   int      ch;
+
+   for (i = 0; i <= len; i++) {
+      ch = i < len ? tolower((unsigned char)s[i]) : ' ';
+      if (ch == '\0' || isspace(ch)) {
+         if (word && (i < len || !open))
+            finder_push(((gram << 8) | ' ') & 0xffffff);
+         word = false;
+         continue;
+      }
+
+      if (!word)
+         gram = (' ' << 8) | ' ';
+      word = true;
+      gram = ((gram << 8) | ch) & 0xffffff;
+      finder_push(gram);
+   }
+}
+
+int
+finder_gram_cmp(const void *a, const void *b)
+{
+   uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+   return x < y ? -1 : x > y;
+}
+
+/* sort the scratch array and drop duplicates */
+void
+finder_grams_unique()
+{
+   size_t i, n = 0;
+
+   qsort(finder.scratch, finder.nscratch, sizeof(uint32_t), finder_gram_cmp);
+   for (i = 0; i < finder.nscratch; i++) {
+      if (n == 0 || finder.scratch[n - 1] != finder.scratch[i])
+         finder.scratch[n++] = finder.scratch[i];
+   }
+   finder.nscratch = n;
+}
+
+
+void
+finder_init()
+{
+   static const size_t init_size = 64;
+
+   memset(&finder, 0, sizeof(finder));
+   finder_table_resize(4096);
+   finder.docs    = finder_grow(NULL, init_size, sizeof(finder_doc));
+   finder.hits    = finder_grow(NULL, init_size, sizeof(uint16_t));
+   finder.touched = finder_grow(NULL, init_size, sizeof(uint32_t));
+   memset(finder.docs, 0, init_size * sizeof(finder_doc));
+   memset(finder.hits, 0, init_size * sizeof(uint16_t));
+   finder.ndocs = init_size;
+   finder.scratch_capacity = 256;
+   finder.scratch = finder_grow(NULL, finder.scratch_capacity, sizeof(uint32_t));
+}
+
+void
+finder_free()
+{
+   size_t i;
+
+   if (finder.active)
+      finder_close();
+
+   for (i = 0; i < finder.table_capacity; i++)
+      free(finder.table[i].slots);
+   for (i = 0; i < finder.ndocs; i++)
+      free(finder.docs[i].grams);
+
+   free(finder.table);
+   free(finder.docs);
+   free(finder.hits);
+   free(finder.touched);
+   free(finder.scratch);
+   memset(&finder, 0, sizeof(finder));
+}
+
+/* (re)index the title and command of client c */
+void
+finder_index(size_t c)
+{
+   client_handle h = client_get_handle(c);
+   uint32_t      slot = h & 0xffffffff;
+   const char   *command;
+   finder_doc   *d;
+   size_t        i, j;
+
+   finder_reserve(slot + 1);
+   d = &finder.docs[slot];
+   d->client = h;
+
+   finder.nscratch = 0;
+   if (client_is_named(c))
+      finder_grams(client_get_name(c), client_get_name_len(c), false);
+   if ((command = client_get_command(c)) != NULL)
+      finder_grams(command, strlen(command), false);
+   finder_grams_unique();
+
+   /* walk the old and new sorted sets, only changes touch the table */
+   i = j = 0;
+   while (i < d->ngrams || j < finder.nscratch) {
+      if (j == finder.nscratch
+      || (i < d->ngrams && d->grams[i] < finder.scratch[j]))
+         finder_posting_remove(d->grams[i++], slot);
+      else if (i == d->ngrams || finder.scratch[j] < d->grams[i])
+         finder_posting_add(finder.scratch[j++], slot);
+      else {
+         i++;
+         j++;
+      }
+   }
+
+   if (finder.nscratch > d->capacity) {
+      d->capacity = finder.nscratch;
+      d->grams = finder_grow(d->grams, d->capacity, sizeof(uint32_t));
+   }
+   memcpy(d->grams, finder.scratch, finder.nscratch * sizeof(uint32_t));
+   d->ngrams = finder.nscratch;
+   finder.stale = true;
+}
+
+/* drop client c, before it is removed */
+void
+finder_forget(size_t c)
+{
+   uint32_t    slot = client_get_handle(c) & 0xffffffff;
+   finder_doc *d;
+   uint32_t    i;
+
+   if (slot >= finder.ndocs)
+      return;
+
+   d = &finder.docs[slot];
+   for (i = 0; i < d->ngrams; i++)
+      finder_posting_remove(d->grams[i], slot);
+   d->ngrams = 0;
+   d->client = 0;
+   finder.stale = true;
+}
+
+/* keep c among the best results if it ranks high enough */
+void
+finder_consider(size_t c, bool full)
+{
+   uint64_t rank;
+   size_t   i;
+
+   finder.nmatches++;
+   rank = client_get_last_active(c) | (full ? (uint64_t)1 << 63 : 0);
+   if (finder.nresults == FINDER_RESULTS) {
+      if (rank <= finder.ranks[FINDER_RESULTS - 1])
+         return;
+      finder.nresults--;
+   }
+
+   for (i = finder.nresults; i > 0 && finder.ranks[i - 1] < rank; i--) {
+      finder.results[i] = finder.results[i - 1];
+      finder.ranks[i] = finder.ranks[i - 1];
+   }
+   finder.results[i] = client_get_handle(c);
+   finder.ranks[i] = rank;
+   finder.nresults++;
+}
+
+void
+finder_query()
+{
+   size_t          need, i, j, c;
+   finder_posting *p;
+   uint32_t        slot, ntouched = 0;
+
+   finder.nresults = 0;
+   finder.nmatches = 0;
+   finder.stale = false;
+
+   finder.nscratch = 0;
+   finder_grams(finder.query, finder.query_len, true);
+   finder_grams_unique();
+
+   if (finder.nscratch == 0) {
+      for (c = 0; c < clients_get_size(); c++)
+         finder_consider(c, true);
+   } else {
+      for (i = 0; i < finder.nscratch; i++) {
+         p = finder_probe(finder.scratch[i]);
+         for (j = 0; j < p->size; j++) {
+            if (finder.hits[p->slots[j]]++ == 0)
+               finder.touched[ntouched++] = p->slots[j];
+         }
+      }
+
+      need = finder.nscratch <= 2 ? finder.nscratch : (finder.nscratch + 1) / 2;
+      for (i = 0; i < ntouched; i++) {
+         slot = finder.touched[i];
+         if (finder.hits[slot] >= need
+         &&  client_from_handle(finder.docs[slot].client, &c))
+            finder_consider(c, finder.hits[slot] == finder.nscratch);
+         finder.hits[slot] = 0;
+      }
+   }
+
+   if (finder.selected >= finder.nresults)
+      finder.selected = finder.nresults > 0 ? finder.nresults - 1 : 0;
+}
+
+
+void
+finder_open()
+{
+   xcb_grab_keyboard_cookie_t cookie;
+
+   if (finder.active)
+      return;
+
+   finder.active = true;
+   finder.query_len = 0;
+   finder.selected = 0;
+   finder.first = 0;
+   finder.stale = true;
+
+   /* so typing works while a client has the focus.  If someone else
+    * holds the keyboard it only works while we have it, nothing to do. */
+   cookie = xcb_grab_keyboard(X.connection, 1, X.window, XCB_CURRENT_TIME,
+         XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+   xcb_discard_reply(X.connection, cookie.sequence);
+   REDRAW = true;
+}
+
+void
+finder_close()
+{
+   if (!finder.active)
+      return;
+
+   finder.active = false;
+   xcb_ungrab_keyboard(X.connection, XCB_CURRENT_TIME);
+   REDRAW_ALL = true;
+   REDRAW = true;
+}
+
+bool
+finder_active()
+{
+   return finder.active;
+}
+
+void
+finder_key(xcb_keysym_t keysym, uint16_t state)
+{
+   size_t c;
+
+   state &= ~KEYS_IGNORED;
+   switch (keysym) {
+   case XK_Escape:
+      finder_close();
+      return;
+   case XK_Return:
+   case XK_KP_Enter:
+      if (finder.stale)
+         finder_query();
+      if (finder.nresults > 0
+      &&  client_from_handle(finder.results[finder.selected], &c))
+         client_focus(c);
+      finder_close();
+      return;
+   case XK_BackSpace:
+      if (finder.query_len > 0)
+         finder.query_len--;
+      finder.selected = 0;
+      finder.first = 0;
+      finder.stale = true;
+      break;
+   case XK_Tab:
+      if (state & XCB_MOD_MASK_SHIFT) {
+         if (finder.selected > 0)
+            finder.selected--;
+      } else if (finder.selected + 1 < finder.nresults)
+         finder.selected++;
+      break;
+   case XK_Down:
+   case XK_Right:
+      if (finder.selected + 1 < finder.nresults)
+         finder.selected++;
+      break;
+   case XK_ISO_Left_Tab:
+   case XK_Up:
+   case XK_Left:
+      if (finder.selected > 0)
+         finder.selected--;
+      break;
+   default:
+      /* Ctrl+U clears the query, other Ctrl combinations aren't text */
+      if (state & XCB_MOD_MASK_CONTROL) {
+         if (keysym != XK_u)
+            return;
+         finder.query_len = 0;
+      } else if (keysym >= 0x20 && keysym < 0x7f
+           &&  finder.query_len + 1 < FINDER_QUERY_MAX)
+         finder.query[finder.query_len++] = keysym;
+      else
+         return;
+      finder.selected = 0;
+      finder.first = 0;
+      finder.stale = true;
+      break;
+   }
+   REDRAW = true;
+}
+
+/* width of the bar entry for client c */
+int32_t
+finder_result_width(size_t c)
+{
+   char    num[24];
+   int     num_len;
+   int32_t width;
+
+   num_len = snprintf(num, sizeof(num), "%zd: ", c);
+   width = x_get_strnwidth(num, num_len) + client_get_name_width(c)
+         + 2 * (X.font_padding + 1);
+
+   if (width < X.tab_min_width)
+      width = X.tab_min_width;
+   if (width > X.tab_max_width)
+      width = X.tab_max_width;
+   return width;
+}
+
+void
+finder_draw_result(size_t c, int32_t x, int32_t width, bool selected)
+{
+   xcb_rectangle_t box = { x, 0, width, X.bar_height };
+   xcb_gcontext_t  gc_fg, gc_bg;
+   char            text[256];
+   int             len;
+
+   gc_fg = selected ? X.gc_bar_curr_fg : X.gc_bar_norm_fg;
+   gc_bg = selected ? X.gc_bar_curr_bg : X.gc_bar_norm_bg;
+
+   len = snprintf(text, sizeof(text), "%zd: %s", c, client_get_name(c));
+   if (len >= (int)sizeof(text))
+      len = sizeof(text) - 1;
+   len = x_get_strfit(text, len, width - 2 * (X.font_padding + 1));
+
+   xcb_poly_fill_rectangle(X.connection, X.bar, gc_bg, 1, &box);
+   xcb_image_text_8(X.connection, len, X.bar, gc_fg,
+         x + X.font_padding + 1,
+         X.bar_height - (X.font_descent + X.font_padding + 1),
+         text);
+   xcb_poly_rectangle(X.connection, X.bar, X.gc_bar_border, 1, &box);
+}
+
+/* paint the prompt and best matches over the whole bar */
+void
+finder_draw()
+{
+   xcb_rectangle_t bar = { 0, 0, X.width, X.bar_height };
+   int32_t         widths[FINDER_RESULTS];
+   size_t          pos[FINDER_RESULTS];
+   char            prompt[FINDER_QUERY_MAX + 32];
+   int32_t         x, used;
+   size_t          i, n, selected;
+   int             len;
+
+   if (finder.stale)
+      finder_query();
+
+   xcb_poly_fill_rectangle(X.connection, X.bar, X.gc_bar_norm_bg, 1, &bar);
+   len = snprintf(prompt, sizeof(prompt), "find: %.*s_  (%zd)",
+         (int)finder.query_len, finder.query, finder.nmatches);
+   xcb_image_text_8(X.connection, len, X.bar, X.gc_bar_norm_fg,
+         X.font_padding + 1,
+         X.bar_height - (X.font_descent + X.font_padding + 1),
+         prompt);
+   x = x_get_strnwidth(prompt, len) + 2 * (X.font_padding + 1);
+
+   /* tabs closed since the query are skipped */
+   selected = finder.selected;
+   for (i = n = 0; i < finder.nresults; i++) {
+      if (!client_from_handle(finder.results[i], &pos[n])) {
+         if (i < selected)
+            finder.selected--;
+         continue;
+      }
+      finder.results[n] = finder.results[i];
+      widths[n] = finder_result_width(pos[n]);
+      n++;
+   }
+   finder.nresults = n;
+   if (finder.selected >= n)
+      finder.selected = n > 0 ? n - 1 : 0;
+
+   /* scroll just enough to show the selected result */
+   if (finder.selected < finder.first)
+      finder.first = finder.selected;
+   for (;;) {
+      used = 0;
+      for (i = finder.first; i <= finder.selected && i < finder.nresults; i++)
+         used += widths[i];
+      if (finder.first == finder.selected || x + used <= X.width)
+         break;
+      finder.first++;
+   }
+
+   for (i = finder.first; i < finder.nresults && x < X.width; i++) {
+      finder_draw_result(pos[i], x, widths[i], i == finder.selected);
+      x += widths[i];
+   }
+
+   xcb_copy_area(X.connection, X.bar, X.window, X.gc_bar_norm_bg,
+      0, 0, 0, 0, X.width, X.bar_height);
+   EXPOSED = false;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * String interning.  Identical strings (commands are usually the same
+ * handful of browser invocations) share one reference-counted copy.
+ */
+
+#include "intern.h"
+
+typedef struct interned {
+   struct interned *next;
+   uint32_t         hash;
+   size_t           refs;
+   size_t           len;
+   char             s[];
+} interned;
+
+struct intern_table_t {
+   interned **buckets;
+   size_t     capacity;   /* power of two */
+   size_t     size;
+};
+struct intern_table_t interned_strings;
+
+
+uint32_t
+intern_hash(const char *s, size_t len)
+{
+   /* FNV-1a */
+   uint32_t h = 2166136261u;
+   size_t   i;
+
+   for (i = 0; i < len; i++) {
+      h ^= (unsigned char)s[i];
+      h *= 16777619u;
+   }
+   return h;
+}
+
+interned*
+intern_entry(const char *s)
+{
+   return (interned*)(s - offsetof(interned, s));
+}
+
+void
+intern_grow()
+{
+   interned **old = interned_strings.buckets;
+   interned  *e, *next;
+   size_t     old_capacity = interned_strings.capacity;
+   size_t     i;
+
+   interned_strings.capacity = old_capacity == 0 ? 64 : old_capacity * 2;
+   if ((interned_strings.buckets = calloc(interned_strings.capacity, sizeof(interned*))) == NULL)
+      err(1, "%s: calloc(3) failed", __FUNCTION__);
+
+   for (i = 0; i < old_capacity; i++) {
+      for (e = old[i]; e != NULL; e = next) {
+         next = e->next;
+         e->next = interned_strings.buckets[e->hash & (interned_strings.capacity - 1)];
+         interned_strings.buckets[e->hash & (interned_strings.capacity - 1)] = e;
+      }
+   }
+   free(old);
+}
+
+/* shared, NUL-terminated copy of s[0..len), release with intern_release() */
+const char*
+intern(const char *s, size_t len)
+{
+   uint32_t  h = intern_hash(s, len);
+   interned *e;
+
+   if (interned_strings.size >= interned_strings.capacity)
+      intern_grow();
+
+   for (e = interned_strings.buckets[h & (interned_strings.capacity - 1)]; e != NULL; e = e->next) {
+      if (e->hash == h && e->len == len && memcmp(e->s, s, len) == 0) {
+         e->refs++;
+         return e->s;
+      }
+   }
+
+   if ((e = malloc(sizeof(interned) + len + 1)) == NULL)
+      err(1, "%s: malloc(3) failed", __FUNCTION__);
+
+   e->hash = h;
+   e->refs = 1;
+   e->len  = len;
+   memcpy(e->s, s, len);
+   e->s[len] = '\0';
+   e->next = interned_strings.buckets[h & (interned_strings.capacity - 1)];
+   interned_strings.buckets[h & (interned_strings.capacity - 1)] = e;
+   interned_strings.size++;
+   return e->s;
+}
+
+void
+intern_release(const char *s)
+{
+   interned  *e, **p;
+
+   if (s == NULL)
+      return;
+
+   e = intern_entry(s);
+   if (--e->refs > 0)
+      return;
+
+   for (p = &interned_strings.buckets[e->hash & (interned_strings.capacity - 1)]; *p != e; p = &(*p)->next)
+      ;
+   *p = e->next;
+   interned_strings.size--;
+   free(e);
+}
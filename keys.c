@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Key bindings.  Bindings name a keysym and modifiers, e.g. in the
+ * config file
+ *
+ *    bind  Mod4+l       next
+ *    bind  Mod4+Return  spawn xterm -into WINID
+ *    bind  x            none
+ *
+ * and are compiled into a table indexed by keycode and modifier state,
+ * so a keypress is a single lookup.  The table is rebuilt when the
+ * keyboard mapping changes.  A keysym only reachable with Shift (e.g.
+ * "/" on a German layout) is bound with Shift added.  Bindings with
+ * modifiers are also grabbed on our window, so they work while a client
+ * has the focus; plain keys only work while xtabs itself does, as
+ * grabbing them would take them away from the clients.  Caps Lock and
+ * Num Lock (assumed to be Mod2) don't matter.
+ */
+
+#include "keys.h"
+
+typedef enum {
+   ACTION_NONE, ACTION_NEXT, ACTION_PREV, ACTION_QUIT, ACTION_RESTART,
+   ACTION_SPAWN, ACTION_SAVE, ACTION_FIND
+} key_action;
+
+typedef struct {
+   xcb_keysym_t   keysym;
+   uint16_t       mods;
+   key_action     action;
+   char          *arg;        /* spawn: command, NULL for the default */
+} key_binding;
+
+static const char *action_names[] = {
+   "none", "next", "prev", "quit", "restart", "spawn", "save", "find", NULL
+};
+
+static const struct {
+   const char  *name;
+   uint16_t     mask;
+} mod_names[] = {
+   { "Shift", XCB_MOD_MASK_SHIFT },
+   { "Ctrl",  XCB_MOD_MASK_CONTROL },
+   { "Mod1",  XCB_MOD_MASK_1 },
+   { "Alt",   XCB_MOD_MASK_1 },
+   { "Mod3",  XCB_MOD_MASK_3 },
+   { "Mod4",  XCB_MOD_MASK_4 },
+   { "Mod5",  XCB_MOD_MASK_5 },
+};
+
+/* keys with names, everything printable is its own (Latin-1) keysym */
+static const struct {
+   const char   *name;
+   xcb_keysym_t  keysym;
+} key_names[] = {
+   { "space",  XK_space },     { "Return",    XK_Return },
+   { "Tab",    XK_Tab },       { "Escape",    XK_Escape },
+   { "BackSpace", XK_BackSpace }, { "Delete", XK_Delete },
+   { "Left",   XK_Left },      { "Right",     XK_Right },
+   { "Up",     XK_Up },        { "Down",      XK_Down },
+   { "Home",   XK_Home },      { "End",       XK_End },
+   { "Prior",  XK_Prior },     { "Next",      XK_Next },
+   { "F1",  XK_F1 },  { "F2",  XK_F2 },  { "F3",  XK_F3 },  { "F4",  XK_F4 },
+   { "F5",  XK_F5 },  { "F6",  XK_F6 },  { "F7",  XK_F7 },  { "F8",  XK_F8 },
+   { "F9",  XK_F9 },  { "F10", XK_F10 }, { "F11", XK_F11 }, { "F12", XK_F12 },
+};
+
+/* what keypress used to hardcode, as keycodes of a US layout */
+static const char *default_binds[] = {
+   "h prev", "j prev", "k next", "l next", "x quit", "n spawn", "w save",
+   "/ find",
+};
+
+struct keys_t {
+   xcb_key_symbols_t *syms;
+   key_binding       *bindings;
+   size_t             size;
+   uint8_t            table[256][256];  /* keycode, state -> binding + 1 */
+};
+struct keys_t keys;
+
+
+bool
+keys_parse_key(char *s, xcb_keysym_t *keysym, uint16_t *mods)
+{
+   char   *plus;
+   size_t  i;
+
+   *mods = 0;
+   while ((plus = strchr(s, '+')) != NULL && plus[1] != '\0') {
+      *plus = '\0';
+      for (i = 0; i < sizeof(mod_names) / sizeof(mod_names[0]); i++) {
+         if (strcasecmp(mod_names[i].name, s) == 0)
+            break;
+      }
+      if (i == sizeof(mod_names) / sizeof(mod_names[0]))
+         return false;
+      *mods |= mod_names[i].mask;
+      s = plus + 1;
+   }
+
+   if (strlen(s) == 1 && (unsigned char)s[0] > 0x20) {
+      *keysym = (unsigned char)s[0];
+      return true;
+   }
+
+   for (i = 0; i < sizeof(key_names) / sizeof(key_names[0]); i++) {
+      if (strcmp(key_names[i].name, s) == 0) {
+         *keysym = key_names[i].keysym;
+         return true;
+      }
+   }
+   return false;
+}
+
+/* "key action [argument]", false if that makes no sense */
+bool
+keys_add(const char *spec)
+{
+   key_binding *b, *new_bindings;
+   char        *copy, *p, *key, *action;
+   size_t       i;
+
+   if ((copy = strdup(spec)) == NULL)
+      err(1, "%s: strdup failed.", __FUNCTION__);
+
+   p = copy;
+   key = strsep(&p, " \t");
+   while (p != NULL && (*p == ' ' || *p == '\t'))
+      p++;
+   action = strsep(&p, " \t");
+   while (p != NULL && (*p == ' ' || *p == '\t'))
+      p++;
+
+   new_bindings = realloc(keys.bindings, (keys.size + 1) * sizeof(key_binding));
+   if (new_bindings == NULL)
+      err(1, "%s: reallocation failed (%zd).", __FUNCTION__, keys.size + 1);
+   keys.bindings = new_bindings;
+   b = &keys.bindings[keys.size];
+
+   for (i = 0; action != NULL && action_names[i] != NULL; i++) {
+      if (strcmp(action_names[i], action) == 0)
+         break;
+   }
+
+   if (action == NULL || action_names[i] == NULL
+   ||  !keys_parse_key(key, &b->keysym, &b->mods)) {
+      free(copy);
+      return false;
+   }
+
+   b->action = i;
+   b->arg = NULL;
+   if (p != NULL && *p != '\0' && (b->arg = strdup(p)) == NULL)
+      err(1, "%s: strdup failed.", __FUNCTION__);
+
+   keys.size++;
+   free(copy);
+   return true;
+}
+
+/* (re)compile the lookup table and grabs for the current mapping */
+void
+keys_build()
+{
+   static const uint16_t ignored[] = {
+      0, XCB_MOD_MASK_LOCK, XCB_MOD_MASK_2, XCB_MOD_MASK_LOCK | XCB_MOD_MASK_2
+   };
+   xcb_keycode_t *codes;
+   size_t         i, j, k;
+   uint16_t       mods;
+
+   memset(keys.table, 0, sizeof(keys.table));
+   xcb_ungrab_key(X.connection, XCB_GRAB_ANY, X.window, XCB_MOD_MASK_ANY);
+
+   /* later bindings of the same key win */
+   for (i = 0; i < keys.size; i++) {
+      codes = xcb_key_symbols_get_keycode(keys.syms, keys.bindings[i].keysym);
+      for (j = 0; codes != NULL && codes[j] != XCB_NO_SYMBOL; j++) {
+         /* the shifted column is what a keypress with Shift looks up */
+         mods = keys.bindings[i].mods;
+         if (xcb_key_symbols_get_keysym(keys.syms, codes[j], 0) != keys.bindings[i].keysym
+         &&  xcb_key_symbols_get_keysym(keys.syms, codes[j], 1) == keys.bindings[i].keysym)
+            mods |= XCB_MOD_MASK_SHIFT;
+
+         keys.table[codes[j]][mods] =
+            keys.bindings[i].action == ACTION_NONE ? 0 : i + 1;
+
+         /* a plain key is still plain if it needs Shift */
+         if (keys.bindings[i].mods == 0 || keys.bindings[i].action == ACTION_NONE)
+            continue;
+
+         for (k = 0; k < sizeof(ignored) / sizeof(ignored[0]); k++) {
+            xcb_grab_key(X.connection, 1, X.window,
+               mods | ignored[k], codes[j],
+               XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+         }
+      }
+      free(codes);
+   }
+}
+
+
+/* after x_init() and config_load() */
+void
+keys_init()
+{
+   size_t i;
+
+   if ((keys.syms = xcb_key_symbols_alloc(X.connection)) == NULL)
+      errx(1, "%s: failed to load the keyboard mapping", __FUNCTION__);
+
+   for (i = 0; i < sizeof(default_binds) / sizeof(default_binds[0]); i++)
+      keys_add(default_binds[i]);
+
+   for (i = 0; i < S.nbinds; i++) {
+      if (!keys_add(S.binds[i]))
+         warnx("bad key binding '%s'", S.binds[i]);
+   }
+
+   if (keys.size > 255)
+      errx(1, "%s: too many key bindings (%zd)", __FUNCTION__, keys.size);
+
+   keys_build();
+}
+
+void
+keys_free()
+{
+   size_t i;
+
+   for (i = 0; i < keys.size; i++)
+      free(keys.bindings[i].arg);
+   free(keys.bindings);
+   keys.bindings = NULL;
+   keys.size = 0;
+   xcb_key_symbols_free(keys.syms);
+}
+
+void
+keys_dispatch(xcb_keycode_t keycode, uint16_t state)
+{
+   key_binding *b;
+   uint8_t      i;
+
+   /* the finder has the keyboard grabbed and takes every key */
+   if (finder_active()) {
+      finder_key(xcb_key_symbols_get_keysym(keys.syms, keycode,
+            state & XCB_MOD_MASK_SHIFT ? 1 : 0), state);
+      return;
+   }
+
+   if ((i = keys.table[keycode][state & 0xff & ~KEYS_IGNORED]) == 0)
+      return;
+
+   b = &keys.bindings[i - 1];
+   switch (b->action) {
+   case ACTION_NONE:
+      break;
+   case ACTION_NEXT:
+      client_next(1);
+      break;
+   case ACTION_PREV:
+      client_prev(1);
+      break;
+   case ACTION_QUIT:
+      SIG_QUIT = 1;
+      break;
+   case ACTION_RESTART:
+      SIG_RESTART = 1;
+      SIG_QUIT = 1;
+      break;
+   case ACTION_SPAWN:
+      spawn(b->arg);
+      break;
+   case ACTION_SAVE:
+      session_compact();
+      break;
+   case ACTION_FIND:
+      finder_open();
+      break;
+   }
+}
+
+void
+keys_mapping_notify(xcb_mapping_notify_event_t *e)
+{
+   xcb_refresh_keyboard_mapping(keys.syms, e);
+   if (e->request != XCB_MAPPING_POINTER)
+      keys_build();
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Tab layout.  Computes the width of every tab and keeps the result as a
+ * prefix sum of tab edges: tab c spans [edges[c], edges[c + 1]) on a strip
+ * as long as all tabs together.  Positions are then O(1) and finding the
+ * tab under an x coordinate is a binary search.
+ *
+ * X.tab_layout selects how widths are chosen:
+ *    LAYOUT_FIXED    every tab is X.tab_width
+ *    LAYOUT_FIT      fit the index label and title, within min/max width
+ *    LAYOUT_SHARED   share the bar width evenly, within min/max width
+ *
+ * The layout is only recomputed after layout_invalidate(), i.e. when
+ * titles, the set of tabs or the geometry change, not on every redraw.
+ */
+
+#include "layout.h"
+
+struct layout_t {
+   int32_t  *edges;
+   size_t    capacity;
+   size_t    size;       /* tabs laid out */
+   bool      valid;
+};
+struct layout_t layout;
+
+
+uint16_t
+layout_clamp(int32_t w)
+{
+   if (w < X.tab_min_width)
+      return X.tab_min_width;
+   if (w > X.tab_max_width)
+      return X.tab_max_width;
+   return w;
+}
+
+/* width of the "N: " label in front of a title */
+int32_t
+layout_label_width(size_t c)
+{
+   char num[24];
+   int  len = snprintf(num, sizeof(num), "%zd: ", c);
+
+   return x_get_strnwidth(num, len);
+}
+
+/*
+ * Recompute the edges if needed.  Tabs that moved or changed width are
+ * marked dirty so the damage-tracked redraw repaints them.
+ */
+void
+layout_update()
+{
+   size_t   c, n = clients_get_size();
+   uint16_t w = X.tab_width;
+   int32_t  left, old_right;
+
+   if (layout.valid && layout.size == n)
+      return;
+
+   if (n + 1 > layout.capacity) {
+      layout.capacity = layout.capacity == 0 ? 64 : layout.capacity;
+      while (layout.capacity < n + 1)
+         layout.capacity *= 2;
+      if ((layout.edges = realloc(layout.edges, layout.capacity * sizeof(int32_t))) == NULL)
+         err(1, "%s: reallocation failed (%zd).", __FUNCTION__, layout.capacity);
+   }
+
+   if (X.tab_layout == LAYOUT_SHARED && n > 0)
+      w = layout_clamp(X.width / n);
+
+   layout.edges[0] = 0;
+   for (c = 0; c < n; c++) {
+      if (X.tab_layout == LAYOUT_FIT)
+         w = layout_clamp(layout_label_width(c) + client_get_name_width(c)
+                        + 2 * (X.font_padding + 1));
+
+      left = layout.edges[c];
+      old_right = c < layout.size ? layout.edges[c + 1] : -1;
+      layout.edges[c + 1] = left + w;
+      if (layout.edges[c + 1] != old_right)
+         client_set_dirty(c);
+      if (c + 1 < n && layout.edges[c + 1] != old_right)
+         client_set_dirty(c + 1);
+   }
+
+   layout.size = n;
+   layout.valid = true;
+}
+
+void
+layout_free()
+{
+   free(layout.edges);
+   layout.edges = NULL;
+   layout.capacity = 0;
+   layout.valid = false;
+}
+
+void
+layout_invalidate()
+{
+   layout.valid = false;
+}
+
+/* left edge of tab c, relative to the start of the first tab */
+int32_t
+layout_get_x(size_t c)
+{
+   layout_update();
+   if (c > layout.size)
+      errx(1, "%s: index out-of-bounds (%zd,%zd).", __FUNCTION__, c, layout.size);
+
+   return layout.edges[c];
+}
+
+uint16_t
+layout_get_width(size_t c)
+{
+   return layout_get_x(c + 1) - layout_get_x(c);
+}
+
+int32_t
+layout_get_total()
+{
+   return layout_get_x(clients_get_size());
+}
+
+/*
+ * Index of the tab containing strip coordinate x: the last c with
+ * edges[c] <= x.  Returns the number of tabs if x is past the end.
+ */
+size_t
+layout_find(int32_t x)
+{
+   size_t lo = 0, hi, mid;
+
+   layout_update();
+   hi = layout.size;
+   if (x < 0)
+      return 0;
+   if (x >= layout.edges[layout.size])
+      return layout.size;
+
+   while (hi - lo > 1) {
+      mid = lo + (hi - lo) / 2;
+      if (layout.edges[mid] <= x)
+         lo = mid;
+      else
+         hi = mid;
+   }
+   return lo;
+}
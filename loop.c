@@ -0,0 +1,519 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The event loop's reactor: the one place where xtabs sleeps.  It waits on
+ * registered file descriptors (the X connection, sockets), one-shot timers
+ * for deferred work and signals, and dispatches each to its callback from
+ * loop_wait().  Signals are never handled asynchronously; they're turned
+ * into readable events like everything else.
+ *
+ * On Linux this is epoll with a signalfd and one timerfd per timer.
+ * Elsewhere it falls back to poll(2), a self-pipe for signals and timer
+ * deadlines folded into the poll timeout.
+ */
+
+/* CLOCK_MONOTONIC and sigprocmask(2) are POSIX, not c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#else
+#include <poll.h>
+#endif
+
+#include "loop.h"
+
+typedef enum { SOURCE_FD, SOURCE_TIMER, SOURCE_SIGNAL } source_type;
+
+typedef struct {
+   source_type    type;
+   int            fd;
+   int            events;     /* LOOP_READ, LOOP_WRITE */
+   int            ready;      /* of those, what to dispatch */
+   loop_fd_cb     fd_cb;
+   loop_timer_cb  timer_cb;
+   void          *arg;
+   bool           armed;
+   bool           dead;       /* removed, freed after dispatching */
+   uint64_t       deadline;   /* poll backend only */
+} loop_source;
+
+struct loop_t {
+   loop_source  **fds;
+   size_t         nfds;
+   loop_source  **timers;
+   size_t         ntimers;
+   loop_source    signals;
+   sigset_t       sigmask;
+   loop_signal_cb on_signal;
+   int            backend;    /* epoll fd, or write end of the self-pipe */
+};
+struct loop_t loop;
+
+
+loop_source *
+loop_new_source(source_type type, int fd)
+{
+   loop_source *s;
+
+   if ((s = calloc(1, sizeof(loop_source))) == NULL)
+      err(1, "%s: calloc(3) failed", __FUNCTION__);
+
+   s->type = type;
+   s->fd = fd;
+   return s;
+}
+
+loop_source **
+loop_append(loop_source **list, size_t *n, loop_source *s)
+{
+   if ((list = realloc(list, (*n + 1) * sizeof(loop_source*))) == NULL)
+      err(1, "%s: reallocation failed (%zd).", __FUNCTION__, *n + 1);
+
+   list[(*n)++] = s;
+   return list;
+}
+
+uint64_t
+loop_now()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool
+loop_timer_armed(int t)
+{
+   return loop.timers[t]->armed;
+}
+
+loop_source *
+loop_find_fd(int fd)
+{
+   size_t i;
+
+   for (i = 0; i < loop.nfds; i++) {
+      if (loop.fds[i]->fd == fd && !loop.fds[i]->dead)
+         return loop.fds[i];
+   }
+   return NULL;
+}
+
+/*
+ * Sources may be removed from within a callback while other events for
+ * them are still pending, so they're only marked here and freed once
+ * loop_wait() is done dispatching.
+ */
+void
+loop_remove_fd(int fd)
+{
+   loop_source *s;
+
+   if ((s = loop_find_fd(fd)) == NULL)
+      return;
+
+#ifdef __linux__
+   epoll_ctl(loop.backend, EPOLL_CTL_DEL, fd, NULL);
+#endif
+   s->dead = true;
+}
+
+void
+loop_reap()
+{
+   size_t i = 0;
+
+   while (i < loop.nfds) {
+      if (loop.fds[i]->dead) {
+         free(loop.fds[i]);
+         loop.fds[i] = loop.fds[--loop.nfds];
+      } else
+         i++;
+   }
+}
+
+void
+loop_free()
+{
+   size_t i;
+
+   for (i = 0; i < loop.nfds; i++)
+      free(loop.fds[i]);
+   for (i = 0; i < loop.ntimers; i++) {
+#ifdef __linux__
+      close(loop.timers[i]->fd);
+#endif
+      free(loop.timers[i]);
+   }
+
+   free(loop.fds);
+   free(loop.timers);
+   close(loop.signals.fd);
+   close(loop.backend);
+   sigprocmask(SIG_UNBLOCK, &loop.sigmask, NULL);
+   memset(&loop, 0, sizeof(loop));
+}
+
+void
+loop_dispatch(loop_source *s)
+{
+   uint64_t expirations;
+#ifdef __linux__
+   struct signalfd_siginfo si;
+#else
+   unsigned char signo;
+#endif
+
+   if (s->dead)
+      return;
+
+   switch (s->type) {
+   case SOURCE_FD:
+      if (s->fd_cb != NULL)
+         s->fd_cb(s->fd, s->ready, s->arg);
+      break;
+
+   case SOURCE_TIMER:
+#ifdef __linux__
+      if (read(s->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+         return;
+#else
+      (void)expirations;
+#endif
+      s->armed = false;
+      s->timer_cb(s->arg);
+      break;
+
+   case SOURCE_SIGNAL:
+#ifdef __linux__
+      while (read(s->fd, &si, sizeof(si)) == sizeof(si))
+         loop.on_signal(si.ssi_signo);
+#else
+      while (read(s->fd, &signo, 1) == 1)
+         loop.on_signal(signo);
+#endif
+      break;
+   }
+}
+
+#ifdef __linux__
+
+void
+loop_init(loop_signal_cb on_signal)
+{
+   struct epoll_event ev;
+
+   if ((loop.backend = epoll_create1(EPOLL_CLOEXEC)) == -1)
+      err(1, "%s: epoll_create1 failed", __FUNCTION__);
+
+   sigemptyset(&loop.sigmask);
+   loop.on_signal = on_signal;
+   loop.signals.type = SOURCE_SIGNAL;
+   loop.signals.fd = signalfd(-1, &loop.sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+   if (loop.signals.fd == -1)
+      err(1, "%s: signalfd failed", __FUNCTION__);
+
+   ev.events = EPOLLIN;
+   ev.data.ptr = &loop.signals;
+   if (epoll_ctl(loop.backend, EPOLL_CTL_ADD, loop.signals.fd, &ev) == -1)
+      err(1, "%s: epoll_ctl failed", __FUNCTION__);
+}
+
+void
+loop_add_signal(int sig)
+{
+   /* blocked signals are only ever delivered through the signalfd */
+   sigaddset(&loop.sigmask, sig);
+   if (sigprocmask(SIG_BLOCK, &loop.sigmask, NULL) == -1)
+      err(1, "%s: sigprocmask failed", __FUNCTION__);
+   if (signalfd(loop.signals.fd, &loop.sigmask, 0) == -1)
+      err(1, "%s: signalfd failed", __FUNCTION__);
+}
+
+uint32_t
+loop_epoll_events(int events)
+{
+   return (events & LOOP_READ  ? EPOLLIN  : 0)
+        | (events & LOOP_WRITE ? EPOLLOUT : 0);
+}
+
+void
+loop_add_fd(int fd, int events, loop_fd_cb cb, void *arg)
+{
+   struct epoll_event ev;
+   loop_source       *s = loop_new_source(SOURCE_FD, fd);
+
+   s->events = events;
+   s->fd_cb = cb;
+   s->arg = arg;
+   ev.events = loop_epoll_events(events);
+   ev.data.ptr = s;
+   if (epoll_ctl(loop.backend, EPOLL_CTL_ADD, fd, &ev) == -1)
+      err(1, "%s: epoll_ctl failed", __FUNCTION__);
+
+   loop.fds = loop_append(loop.fds, &loop.nfds, s);
+}
+
+/* change what a registered file descriptor is watched for */
+void
+loop_set_fd(int fd, int events)
+{
+   struct epoll_event ev;
+   loop_source       *s;
+
+   if ((s = loop_find_fd(fd)) == NULL || s->events == events)
+      return;
+
+   s->events = events;
+   ev.events = loop_epoll_events(events);
+   ev.data.ptr = s;
+   if (epoll_ctl(loop.backend, EPOLL_CTL_MOD, fd, &ev) == -1)
+      err(1, "%s: epoll_ctl failed", __FUNCTION__);
+}
+
+int
+loop_add_timer(loop_timer_cb cb, void *arg)
+{
+   struct epoll_event ev;
+   loop_source       *s;
+   int                fd;
+
+   if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+      err(1, "%s: timerfd_create failed", __FUNCTION__);
+
+   s = loop_new_source(SOURCE_TIMER, fd);
+   s->timer_cb = cb;
+   s->arg = arg;
+   ev.events = EPOLLIN;
+   ev.data.ptr = s;
+   if (epoll_ctl(loop.backend, EPOLL_CTL_ADD, fd, &ev) == -1)
+      err(1, "%s: epoll_ctl failed", __FUNCTION__);
+
+   loop.timers = loop_append(loop.timers, &loop.ntimers, s);
+   return loop.ntimers - 1;
+}
+
+/* (re)arm a one-shot timer; re-arming an armed timer pushes it back */
+void
+loop_arm_timer(int t, uint32_t msec)
+{
+   struct itimerspec its;
+
+   memset(&its, 0, sizeof(its));
+   its.it_value.tv_sec  = msec / 1000;
+   its.it_value.tv_nsec = (msec % 1000) * 1000000 + (msec == 0);
+   if (timerfd_settime(loop.timers[t]->fd, 0, &its, NULL) == -1)
+      err(1, "%s: timerfd_settime failed", __FUNCTION__);
+
+   loop.timers[t]->armed = true;
+}
+
+void
+loop_disarm_timer(int t)
+{
+   struct itimerspec its;
+
+   memset(&its, 0, sizeof(its));
+   timerfd_settime(loop.timers[t]->fd, 0, &its, NULL);
+   loop.timers[t]->armed = false;
+}
+
+void
+loop_wait()
+{
+   struct epoll_event evs[16];
+   loop_source       *s;
+   int                i, n;
+
+   if ((n = epoll_wait(loop.backend, evs, 16, -1)) == -1) {
+      if (errno == EINTR)
+         return;
+      err(1, "%s: epoll_wait failed", __FUNCTION__);
+   }
+
+   /* errors and hangups show up on the next read or write */
+   for (i = 0; i < n; i++) {
+      s = evs[i].data.ptr;
+      s->ready = 0;
+      if (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+         s->ready |= s->events & LOOP_READ;
+      if (evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+         s->ready |= s->events & LOOP_WRITE;
+      loop_dispatch(s);
+   }
+
+   loop_reap();
+}
+
+#else /* !__linux__ */
+
+void
+loop_signal_handler(int sig)
+{
+   unsigned char signo = sig;
+   int           saved = errno;
+
+   write(loop.backend, &signo, 1);
+   errno = saved;
+}
+
+void
+loop_init(loop_signal_cb on_signal)
+{
+   int p[2];
+
+   if (pipe(p) == -1)
+      err(1, "%s: pipe failed", __FUNCTION__);
+
+   fcntl(p[0], F_SETFL, O_NONBLOCK);
+   fcntl(p[1], F_SETFL, O_NONBLOCK);
+   fcntl(p[0], F_SETFD, FD_CLOEXEC);
+   fcntl(p[1], F_SETFD, FD_CLOEXEC);
+
+   sigemptyset(&loop.sigmask);
+   loop.on_signal = on_signal;
+   loop.signals.type = SOURCE_SIGNAL;
+   loop.signals.fd = p[0];
+   loop.backend = p[1];
+}
+
+void
+loop_add_signal(int sig)
+{
+   struct sigaction sa;
+
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = loop_signal_handler;
+   sa.sa_flags = SA_RESTART;
+   sigemptyset(&sa.sa_mask);
+   if (sigaction(sig, &sa, NULL) == -1)
+      err(1, "%s: sigaction failed", __FUNCTION__);
+}
+
+void
+loop_add_fd(int fd, int events, loop_fd_cb cb, void *arg)
+{
+   loop_source *s = loop_new_source(SOURCE_FD, fd);
+
+   s->events = events;
+   s->fd_cb = cb;
+   s->arg = arg;
+   loop.fds = loop_append(loop.fds, &loop.nfds, s);
+}
+
+/* change what a registered file descriptor is watched for */
+void
+loop_set_fd(int fd, int events)
+{
+   loop_source *s;
+
+   if ((s = loop_find_fd(fd)) != NULL)
+      s->events = events;
+}
+
+int
+loop_add_timer(loop_timer_cb cb, void *arg)
+{
+   loop_source *s = loop_new_source(SOURCE_TIMER, -1);
+
+   s->timer_cb = cb;
+   s->arg = arg;
+   loop.timers = loop_append(loop.timers, &loop.ntimers, s);
+   return loop.ntimers - 1;
+}
+
+void
+loop_arm_timer(int t, uint32_t msec)
+{
+   loop.timers[t]->deadline = loop_now() + msec;
+   loop.timers[t]->armed = true;
+}
+
+void
+loop_disarm_timer(int t)
+{
+   loop.timers[t]->armed = false;
+}
+
+void
+loop_wait()
+{
+   struct pollfd pfds[64];
+   uint64_t      now, next = UINT64_MAX;
+   size_t        i, n;
+   int           timeout = -1;
+
+   for (i = 0; i < loop.ntimers; i++) {
+      if (loop.timers[i]->armed && loop.timers[i]->deadline < next)
+         next = loop.timers[i]->deadline;
+   }
+   if (next != UINT64_MAX) {
+      now = loop_now();
+      timeout = next > now ? (int)(next - now) : 0;
+   }
+
+   pfds[0].fd = loop.signals.fd;
+   pfds[0].events = POLLIN;
+   for (n = 1, i = 0; i < loop.nfds && n < 64; i++, n++) {
+      pfds[n].fd = loop.fds[i]->fd;
+      pfds[n].events = (loop.fds[i]->events & LOOP_READ  ? POLLIN  : 0)
+                     | (loop.fds[i]->events & LOOP_WRITE ? POLLOUT : 0);
+   }
+
+   if (poll(pfds, n, timeout) == -1) {
+      if (errno == EINTR)
+         return;
+      err(1, "%s: poll failed", __FUNCTION__);
+   }
+
+   if (pfds[0].revents & POLLIN)
+      loop_dispatch(&loop.signals);
+
+   /* pfds[i] matches loop.fds[i - 1], removed sources are skipped */
+   for (i = 1; i < n; i++) {
+      if (pfds[i].revents == 0)
+         continue;
+      loop.fds[i - 1]->ready = 0;
+      if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL))
+         loop.fds[i - 1]->ready |= loop.fds[i - 1]->events & LOOP_READ;
+      if (pfds[i].revents & (POLLOUT | POLLERR | POLLHUP | POLLNVAL))
+         loop.fds[i - 1]->ready |= loop.fds[i - 1]->events & LOOP_WRITE;
+      loop_dispatch(loop.fds[i - 1]);
+   }
+
+   now = loop_now();
+   for (i = 0; i < loop.ntimers; i++) {
+      if (loop.timers[i]->armed && loop.timers[i]->deadline <= now)
+         loop_dispatch(loop.timers[i]);
+   }
+
+   loop_reap();
+}
+
+#endif
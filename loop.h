@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <err.h>
+
+/* what a file descriptor is watched for, and what it's ready for */
+#define LOOP_READ    0x1
+#define LOOP_WRITE   0x2
+
+typedef void (*loop_fd_cb)(int fd, int ready, void *arg);
+typedef void (*loop_timer_cb)(void *arg);
+typedef void (*loop_signal_cb)(int sig);
+
+void     loop_init(loop_signal_cb on_signal);
+void     loop_free();
+void     loop_add_signal(int sig);
+void     loop_add_fd(int fd, int events, loop_fd_cb cb, void *arg);
+void     loop_set_fd(int fd, int events);
+void     loop_remove_fd(int fd);
+int      loop_add_timer(loop_timer_cb cb, void *arg);
+void     loop_arm_timer(int t, uint32_t msec);
+void     loop_disarm_timer(int t);
+bool     loop_timer_armed(int t);
+uint64_t loop_now();
+void     loop_wait();
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Hot restart (SIGUSR1): re-exec xtabs without killing the clients.
+ *
+ * Before exec'ing, the tab table is written to an unlinked temporary
+ * file whose descriptor is passed on in $XTABS_RESTART_FD, and our
+ * window is kept alive past the end of the X connection (see x_detach())
+ * so the clients inside it are too.  The new process takes that window
+ * over in x_init() and re-adopts its children, keeping tab order,
+ * titles and focus.  Tabs whose window went away in between are dropped.
+ *
+ * The file has the window id and the focused position on the first line
+ * and then one "window<TAB>title<TAB>command" line per tab, window 0
+ * meaning a placeholder.
+ */
+
+#include "restart.h"
+
+FILE *restart_file = NULL;
+
+
+void
+restart_put(FILE *f, const char *s)
+{
+   for (; s != NULL && *s != '\0'; s++)
+      fputc(*s == '\t' || *s == '\n' ? ' ' : *s, f);
+}
+
+bool
+restart_is_child(xcb_window_t *children, int nchildren, xcb_window_t w)
+{
+   int i;
+   for (i = 0; i < nchildren; i++) {
+      if (children[i] == w)
+         return true;
+   }
+   return false;
+}
+
+/* take over a window that was in the tab bar of the previous process */
+void
+restart_adopt(size_t c, xcb_window_t w)
+{
+   uint32_t values[1] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
+
+   xcb_change_window_attributes(X.connection, w, XCB_CW_EVENT_MASK, values);
+   client_set_window(c, w);
+
+   /* it may have changed while nobody was listening */
+   xevent_queue_property(w, WM_NAME);
+   xevent_queue_property(w, WM_COMMAND);
+   xevent_queue_property(w, X.atom_net_wm_pid);
+}
+
+
+/* the window to take over if we were restarted, before x_init() */
+xcb_window_t
+restart_init()
+{
+   const char   *fd;
+   unsigned int  window;
+
+   if ((fd = getenv("XTABS_RESTART_FD")) == NULL)
+      return XCB_NONE;
+
+   /* clients mustn't inherit it */
+   unsetenv("XTABS_RESTART_FD");
+
+   if ((restart_file = fdopen(atoi(fd), "r")) == NULL)
+      err(1, "%s: bad XTABS_RESTART_FD '%s'", __FUNCTION__, fd);
+
+   if (fscanf(restart_file, "%x", &window) != 1)
+      errx(1, "%s: bad restart state", __FUNCTION__);
+
+   return window;
+}
+
+/* re-adopt the clients, after clients_init(); false if not restarting */
+bool
+restart_restore()
+{
+   xcb_query_tree_cookie_t  cookie;
+   xcb_query_tree_reply_t  *tree;
+   xcb_window_t            *children;
+   int                      nchildren, i;
+   char                    *line = NULL, *title, *command;
+   unsigned int             window;
+   size_t                   c, focus_pos, focus = 0, linecap = 0;
+
+   if (restart_file == NULL)
+      return false;
+
+   cookie = xcb_query_tree(X.connection, X.window);
+
+   if (fscanf(restart_file, "%zu\n", &focus_pos) != 1)
+      errx(1, "%s: bad restart state", __FUNCTION__);
+
+   if ((tree = xcb_query_tree_reply(X.connection, cookie, NULL)) == NULL)
+      errx(1, "%s: failed to query our window", __FUNCTION__);
+   children = xcb_query_tree_children(tree);
+   nchildren = xcb_query_tree_children_length(tree);
+
+   /* titles and commands may be of any length */
+   for (i = 0; getline(&line, &linecap, restart_file) != -1; i++) {
+      line[strcspn(line, "\n")] = '\0';
+      command = line;
+      window = strtoul(strsep(&command, "\t"), NULL, 16);
+      title = strsep(&command, "\t");
+      if (title == NULL || command == NULL)
+         continue;
+
+      /* gone in the meantime, unless it's a placeholder */
+      if (window == XCB_NONE ? *command == '\0'
+                             : !restart_is_child(children, nchildren, window))
+         continue;
+
+      c = client_add_placeholder(*title != '\0' ? title : NULL,
+            *command != '\0' ? command : NULL);
+      if (window != XCB_NONE)
+         restart_adopt(c, window);
+      if ((size_t)i == focus_pos)
+         focus = c;
+   }
+
+   /* whatever was created while nobody was listening is a new tab */
+   for (i = 0; i < nchildren; i++) {
+      if (!client_find(children[i], &c)) {
+         c = client_add_placeholder(NULL, NULL);
+         restart_adopt(c, children[i]);
+      }
+   }
+
+   free(line);
+   free(tree);
+   fclose(restart_file);
+   restart_file = NULL;
+
+   if (clients_get_size() > 0)
+      client_focus(focus < clients_get_size() ? focus : 0);
+
+   /* the session journal still refers to the old handles */
+   session_compact();
+   return true;
+}
+
+/* never returns */
+void
+restart_exec(char *argv[])
+{
+   FILE  *f;
+   char   fd[16];
+   size_t c;
+
+   session_save();
+
+   if ((f = tmpfile()) == NULL)
+      err(1, "%s: tmpfile(3) failed", __FUNCTION__);
+
+   fprintf(f, "%x\n%zu\n", X.window, clients_get_curr());
+   for (c = 0; c < clients_get_size(); c++) {
+      /* the next process doesn't know which ones we stopped */
+      suspend_thaw(c);
+
+      fprintf(f, "%x\t", client_get_window(c));
+      restart_put(f, client_is_named(c) ? client_get_name(c) : NULL);
+      fputc('\t', f);
+      restart_put(f, client_get_command(c));
+      fputc('\n', f);
+   }
+
+   if (fflush(f) == EOF || fseek(f, 0, SEEK_SET) == -1)
+      err(1, "%s: failed to write restart state", __FUNCTION__);
+
+   control_free();
+   export_free();
+   discard_free();
+   tabcache_free();
+   layout_free();
+   loop_free();
+   keys_free();
+   x_detach();
+   spawner_free();
+
+   snprintf(fd, sizeof(fd), "%d", fileno(f));
+   if (setenv("XTABS_RESTART_FD", fd, 1) == -1)
+      err(1, "%s: setenv(3) failed", __FUNCTION__);
+
+   execvp(argv[0], argv);
+   err(1, "%s: failed to exec '%s'", __FUNCTION__, argv[0]);
+}
@@ -14,47 +14,665 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+/*
+ * A session is a snapshot file plus an append-only journal next to it
+ * (name.journal).  Both hold one record per line, fields separated by
+ * tabs, clients identified by their client_handle (in hex):
+ *
+ *    g <gen>                    generation of the snapshot
+ *    a <id> <title> <command>   tab added at the end (or re-added)
+ *    t <id> <title>             title changed
+ *    c <id> <command>           command changed
+ *    m <id> <pos>               tab moved to position pos
+ *    r <id>                     tab removed
+ *    f <id>                     tab focused
+ *
+ * Changes are only appended to a buffer in memory; a debounce timer
+ * writes them to the journal in one go, so no disk I/O happens while
+ * handling events.  Once the journal grows past JOURNAL_MAX records it
+ * is compacted: the current tabs are formatted as "a" records under the
+ * next generation, and a thread writes them to a temporary file, which
+ * is fsync'ed and renamed over the snapshot before the journal is
+ * truncated and starts over with a "g" record of that generation.
+ * Records aren't idempotent ("m" is), so journal records of a generation
+ * older than the snapshot's are skipped: a crash between the rename and
+ * the truncation must not replay them onto a snapshot that has them.
+ * While the thread runs, changes stay in the buffer.
+ *
+ * Snapshots of older versions, with "flags<TAB>title<TAB>command" lines
+ * ("*" flagging the focused tab) or bare commands, still load.
+ *
+ * Restoring creates all tabs as placeholders (see discard.c) right away
+ * and only spawns the focused one.  The rest are spawned when focused or
+ * by a background queue, at most S.restore_jobs at a time and only
+ * while the load average stays below S.restore_load percent per cpu.
+ */
+
+/* O_CLOEXEC is POSIX, asprintf(3) and getloadavg(3) BSD/GNU; not c99 */
+#define _GNU_SOURCE
+
 #include "session.h"
 
+#define RESTORE_INTERVAL 500        /* msec between restore queue runs */
+#define JOURNAL_DELAY   1000        /* msec changes wait to be written */
+#define JOURNAL_MAX     1000        /* records before compacting */
+
 char *session_file = NULL;
+char *journal_file = NULL;
+int   session_timer = -1;
+
+struct session_restore_t {
+   client_handle *queue;
+   size_t         head, size;
+   int            timer;
+};
+struct session_restore_t restore = { NULL, 0, 0, -1 };
+
+struct session_journal_t {
+   int            fd;
+   char          *buf;              /* records not yet written */
+   size_t         len, capacity;
+   size_t         records;          /* in the journal file */
+   client_handle  focus, written_focus;
+   uint64_t       gen;              /* of the snapshot */
+};
+struct session_journal_t journal = { -1, NULL, 0, 0, 0, 0, 0, 0 };
+
+/* a compaction handed to its thread */
+struct session_compaction_t {
+   pthread_t  thread;
+   bool       running;
+   char      *buf;
+   size_t     len;
+   uint64_t   gen;
+   bool       renamed;              /* the snapshot is now of gen */
+   bool       again;                /* asked for while running */
+   int        pipe[2];              /* the thread signals it's done */
+};
+struct session_compaction_t compaction = { 0, false, NULL, 0, 0, false, false, { -1, -1 } };
+
+/* tabs read back from the snapshot and journal */
+typedef struct {
+   uint64_t  id;
+   char     *title;
+   char     *command;
+} session_entry;
+
+struct session_replay_t {
+   session_entry *es;
+   size_t         size, capacity;
+   uint64_t       focus;
+   uint64_t       next_legacy;      /* ids for lines that have none */
+   uint64_t       gen;              /* of the snapshot */
+   bool           journal;          /* replaying the journal file */
+   bool           skip;             /* journal records the snapshot has */
+};
+struct session_replay_t replay;
+
+
+bool
+session_restore_throttled()
+{
+   double load;
+   long   ncpu;
+
+   if (S.restore_load == 0 || getloadavg(&load, 1) != 1)
+      return false;
+
+   if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+      ncpu = 1;
+
+   return load * 100 > (double)S.restore_load * ncpu;
+}
 
 void
-session_load(const char *name)
+session_restore_timeout(void *arg)
 {
-   FILE  *f;
-   char   line[2000];
+   size_t c;
 
-   /* TODO this will be a setting.
-    * TODO create dir if not exist
-    */
-   const char *tab_dir = "/home/ryan/.xtabs";
-   if (asprintf(&session_file, "%s/%s", tab_dir, name) == 0)
-      err(1, "%s: failed to create session file name.", __FUNCTION__);
+   (void)arg;
+   while (restore.head < restore.size
+   &&     discard_pending_count() < S.restore_jobs
+   &&     !session_restore_throttled()) {
+      /* tabs closed or focused (and so spawned) meanwhile are skipped */
+      if (client_from_handle(restore.queue[restore.head++], &c)
+      &&  client_is_placeholder(c))
+         discard_respawn(c);
+   }
+
+   if (restore.head < restore.size)
+      loop_arm_timer(restore.timer, RESTORE_INTERVAL);
+   else {
+      free(restore.queue);
+      restore.queue = NULL;
+      restore.head = restore.size = 0;
+   }
+}
+
+void
+session_restore_queue(size_t c)
+{
+   client_handle *new_queue;
+
+   if ((new_queue = realloc(restore.queue, (restore.size + 1) * sizeof(client_handle))) == NULL)
+      err(1, "%s: reallocation failed (%zd).", __FUNCTION__, restore.size + 1);
+
+   restore.queue = new_queue;
+   restore.queue[restore.size++] = client_get_handle(c);
+}
+
+
+size_t
+session_replay_find(uint64_t id)
+{
+   size_t i;
+   for (i = 0; i < replay.size; i++) {
+      if (replay.es[i].id == id)
+         break;
+   }
+   return i;
+}
+
+void
+session_replay_set(char **field, const char *value)
+{
+   free(*field);
+   if ((*field = strdup(value != NULL ? value : "")) == NULL)
+      err(1, "%s: strdup failed.", __FUNCTION__);
+}
+
+void
+session_replay_add(uint64_t id, const char *title, const char *command)
+{
+   session_entry *e;
+   size_t         i, new_capacity;
+
+   if ((i = session_replay_find(id)) == replay.size) {
+      if (replay.size == replay.capacity) {
+         new_capacity = replay.capacity == 0 ? 64 : replay.capacity * 2;
+         if ((e = realloc(replay.es, new_capacity * sizeof(session_entry))) == NULL)
+            err(1, "%s: reallocation failed (%zd).", __FUNCTION__, new_capacity);
+         replay.es = e;
+         replay.capacity = new_capacity;
+      }
+      e = &replay.es[replay.size++];
+      e->id = id;
+      e->title = e->command = NULL;
+   } else
+      e = &replay.es[i];
+
+   session_replay_set(&e->title, title);
+   session_replay_set(&e->command, command);
+}
+
+/* one line of either file */
+void
+session_replay_line(char *line)
+{
+   session_entry  e;
+   char          *tag, *a, *b;
+   uint64_t       id;
+   size_t         i, pos;
 
-   if ((f = fopen(session_file, "r")) == NULL)
+   /* old formats: "flags<TAB>title<TAB>command" or a bare command */
+   if (replay.skip && (line[0] != 'g' || line[1] != '\t'))
       return;
+   if (line[0] == '\0' || line[1] != '\t' || strchr("gatcmrf", line[0]) == NULL) {
+      id = replay.next_legacy--;
+      a = NULL;
+      b = line;
+      if (strchr(line, '\t') != NULL) {
+         tag = strsep(&b, "\t");
+         a = strsep(&b, "\t");
+         if (b == NULL)
+            return;
+         if (strchr(tag, '*') != NULL)
+            replay.focus = id;
+      }
+      session_replay_add(id, a, b);
+      return;
+   }
 
-   while (fgets(line, sizeof(line), f) != NULL) {
-      line[strlen(line) - 1] = '\0';
-      spawn(line);
+   b = line;
+   tag = strsep(&b, "\t");
+   id = strtoull(strsep(&b, "\t"), NULL, 16);
+   if (tag[0] == 'g') {
+      if (!replay.journal)
+         replay.gen = id;
+      else
+         replay.skip = id < replay.gen;
+      return;
    }
+   a = strsep(&b, "\t");
+   i = session_replay_find(id);
 
+   switch (tag[0]) {
+   case 'a':
+      session_replay_add(id, a, b);
+      break;
+   case 't':
+      if (i < replay.size)
+         session_replay_set(&replay.es[i].title, a);
+      break;
+   case 'c':
+      if (i < replay.size)
+         session_replay_set(&replay.es[i].command, a);
+      break;
+   case 'm':
+      if (i == replay.size || a == NULL)
+         break;
+      if ((pos = strtoul(a, NULL, 10)) >= replay.size)
+         pos = replay.size - 1;
+      e = replay.es[i];
+      if (pos < i)
+         memmove(&replay.es[pos + 1], &replay.es[pos], (i - pos) * sizeof(session_entry));
+      else
+         memmove(&replay.es[i], &replay.es[i + 1], (pos - i) * sizeof(session_entry));
+      replay.es[pos] = e;
+      break;
+   case 'r':
+      if (i == replay.size)
+         break;
+      free(replay.es[i].title);
+      free(replay.es[i].command);
+      memmove(&replay.es[i], &replay.es[i + 1],
+            (replay.size - i - 1) * sizeof(session_entry));
+      replay.size--;
+      break;
+   case 'f':
+      replay.focus = id;
+      break;
+   }
+}
+
+/* false if the file doesn't exist */
+bool
+session_replay_file(const char *path)
+{
+   FILE  *f;
+   char  *line = NULL;
+   size_t linecap = 0;
+
+   if ((f = fopen(path, "r")) == NULL)
+      return false;
+
+   /* a split record would replay its tail as a tab of its own */
+   while (getline(&line, &linecap, f) != -1) {
+      line[strcspn(line, "\n")] = '\0';
+      session_replay_line(line);
+   }
+
+   free(line);
    fclose(f);
+   return true;
 }
 
+/* append a record to the in-memory buffer, tabs & newlines in a, b become spaces */
 void
-session_save()
+session_log(char tag, client_handle id, const char *a, const char *b)
 {
-   FILE  *f;
-   size_t c;
+   const char *fields[2] = { a, b };
+   char        head[32], *new_buf;
+   size_t      i, n, need, new_capacity;
+
+   n = snprintf(head, sizeof(head), "%c\t%llx", tag, (unsigned long long)id);
+   need = journal.len + n + 1
+        + (a != NULL ? strlen(a) + 1 : 0) + (b != NULL ? strlen(b) + 1 : 0);
+
+   if (need > journal.capacity) {
+      new_capacity = journal.capacity == 0 ? 4096 : journal.capacity;
+      while (new_capacity < need)
+         new_capacity *= 2;
+      if ((new_buf = realloc(journal.buf, new_capacity)) == NULL)
+         err(1, "%s: reallocation failed (%zd).", __FUNCTION__, new_capacity);
+      journal.buf = new_buf;
+      journal.capacity = new_capacity;
+   }
+
+   memcpy(journal.buf + journal.len, head, n);
+   journal.len += n;
+   for (i = 0; i < 2 && fields[i] != NULL; i++) {
+      journal.buf[journal.len++] = '\t';
+      for (a = fields[i]; *a != '\0'; a++)
+         journal.buf[journal.len++] = (*a == '\t' || *a == '\n') ? ' ' : *a;
+   }
+   journal.buf[journal.len++] = '\n';
+   journal.records++;
+
+   session_save_later();
+}
+
+/* false if not all of buf could be written to fd */
+bool
+session_write(int fd, const char *buf, size_t len)
+{
+   ssize_t n;
+   size_t  off = 0;
+
+   while (off < len) {
+      if ((n = write(fd, buf + off, len - off)) == -1) {
+         if (errno == EINTR)
+            continue;
+         return false;
+      }
+      off += n;
+   }
+   return true;
+}
 
-   if ((f = fopen(session_file, "w")) == NULL)
-      err(1, "%s: failed to save session to '%s'.", __FUNCTION__, session_file);
+/* write buffered records to the journal */
+void
+session_flush()
+{
+   /* the compaction truncates the journal, appending has to wait */
+   if (compaction.running)
+      return;
 
+   if (journal.focus != journal.written_focus) {
+      journal.written_focus = journal.focus;
+      session_log('f', journal.focus, NULL, NULL);
+   }
+
+   if (!session_write(journal.fd, journal.buf, journal.len))
+      warn("%s: failed to write '%s'", __FUNCTION__, journal_file);
+   journal.len = 0;
+}
+
+/* format the current tabs as the snapshot of the next generation */
+void
+session_compact_format()
+{
+   size_t c;
+
+   /* reuse the record formatting, the buffer is rebuilt from scratch */
+   journal.len = 0;
+   session_log('g', journal.gen + 1, NULL, NULL);
    for (c = 0; c < clients_get_size(); c++) {
-      if (client_get_command(c) != NULL)
-         fprintf(f, "%s\n", client_get_command(c));
+      session_log('a', client_get_handle(c),
+            client_is_named(c) ? client_get_name(c) : "",
+            client_get_command(c) != NULL ? client_get_command(c) : "");
    }
+   if (clients_get_size() > 0)
+      session_log('f', client_get_handle(clients_get_curr()), NULL, NULL);
 
-   fclose(f);
+   /* the buffer goes with it, records logged meanwhile start a new one */
+   compaction.buf = journal.buf;
+   compaction.len = journal.len;
+   compaction.gen = journal.gen + 1;
+   compaction.renamed = false;
+   journal.buf = NULL;
+   journal.len = journal.capacity = 0;
+   journal.records = 0;
+   journal.written_focus = journal.focus;
+}
+
+/* replace the snapshot with the formatted one and start the journal over */
+void
+session_compact_write()
+{
+   char  *tmp, head[32];
+   size_t n;
+   int    fd;
+
+   if (asprintf(&tmp, "%s.tmp", session_file) == -1)
+      err(1, "%s: asprintf(3) failed", __FUNCTION__);
+
+   if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) == -1) {
+      warn("%s: failed to save session to '%s'", __FUNCTION__, tmp);
+      free(tmp);
+      return;
+   }
+
+   if (!session_write(fd, compaction.buf, compaction.len) || fsync(fd) == -1) {
+      warn("%s: failed to save session to '%s'", __FUNCTION__, tmp);
+      close(fd);
+      unlink(tmp);
+      free(tmp);
+      return;
+   }
+   close(fd);
+
+   if (rename(tmp, session_file) == -1) {
+      warn("%s: failed to rename '%s'", __FUNCTION__, tmp);
+      free(tmp);
+      return;
+   }
+   free(tmp);
+   compaction.renamed = true;
+
+   /* even if truncating fails, the "g" record skips what's before it */
+   if (ftruncate(journal.fd, 0) == -1)
+      warn("%s: failed to truncate '%s'", __FUNCTION__, journal_file);
+   n = snprintf(head, sizeof(head), "g\t%llx\n", (unsigned long long)compaction.gen);
+   if (!session_write(journal.fd, head, n))
+      warn("%s: failed to write '%s'", __FUNCTION__, journal_file);
+}
+
+void *
+session_compact_thread(void *arg)
+{
+   (void)arg;
+   session_compact_write();
+   while (write(compaction.pipe[1], "", 1) == -1 && errno == EINTR)
+      ;
+   return NULL;
+}
+
+/* take over the result of session_compact_write() */
+void
+session_compact_apply()
+{
+   if (compaction.renamed)
+      journal.gen = compaction.gen;
+   free(compaction.buf);
+   compaction.buf = NULL;
+}
+
+/* wait for the compaction thread, if any, and take over its result */
+void
+session_compact_join()
+{
+   if (!compaction.running)
+      return;
+
+   if ((errno = pthread_join(compaction.thread, NULL)) != 0)
+      err(1, "%s: pthread_join(3) failed", __FUNCTION__);
+   compaction.running = false;
+
+   session_compact_apply();
+}
+
+void
+session_compact_done(int fd, int ready, void *arg)
+{
+   char c;
+
+   (void)ready;
+   (void)arg;
+   while (read(fd, &c, 1) == -1 && errno == EINTR)
+      ;
+
+   session_compact_join();
+   if (compaction.again) {
+      compaction.again = false;
+      session_compact();
+   } else if (journal.len > 0 || journal.focus != journal.written_focus)
+      session_save_later();
+}
+
+/*
+ * Compact in a thread, so neither the writes nor the fsync block events.
+ * Asked for while a compaction runs, another follows once it's done.
+ */
+void
+session_compact()
+{
+   if (session_file == NULL)
+      return;
+
+   if (compaction.running) {
+      compaction.again = true;
+      return;
+   }
+
+   if (compaction.pipe[0] == -1) {
+      if (pipe(compaction.pipe) == -1)
+         err(1, "%s: pipe failed", __FUNCTION__);
+      fcntl(compaction.pipe[0], F_SETFL, O_NONBLOCK);
+      fcntl(compaction.pipe[0], F_SETFD, FD_CLOEXEC);
+      fcntl(compaction.pipe[1], F_SETFD, FD_CLOEXEC);
+      loop_add_fd(compaction.pipe[0], LOOP_READ, session_compact_done, NULL);
+   }
+
+   session_compact_format();
+   compaction.running = true;
+   if ((errno = pthread_create(&compaction.thread, NULL, session_compact_thread, NULL)) != 0) {
+      warn("%s: pthread_create(3) failed, compacting in place", __FUNCTION__);
+      compaction.running = false;
+      session_compact_write();
+      session_compact_apply();
+   }
+}
+
+void
+session_save_timeout(void *arg)
+{
+   (void)arg;
+   session_flush();
+   if (journal.records > JOURNAL_MAX)
+      session_compact();
+}
+
+/* bursts of changes end up as a single write, at most JOURNAL_DELAY late */
+void
+session_save_later()
+{
+   if (session_timer == -1)
+      session_timer = loop_add_timer(session_save_timeout, NULL);
+
+   if (!loop_timer_armed(session_timer))
+      loop_arm_timer(session_timer, JOURNAL_DELAY);
+}
+
+
+/* set up the files of session name, without loading it */
+void
+session_init(const char *name)
+{
+   if (mkdir(config_dir(), 0700) == -1 && errno != EEXIST)
+      warn("%s: failed to create '%s'", __FUNCTION__, config_dir());
+
+   if (asprintf(&session_file, "%s/%s", config_dir(), name) == -1)
+      err(1, "%s: failed to create session file name.", __FUNCTION__);
+   if (asprintf(&journal_file, "%s.journal", session_file) == -1)
+      err(1, "%s: failed to create journal file name.", __FUNCTION__);
+
+   if ((journal.fd = open(journal_file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600)) == -1)
+      err(1, "%s: failed to open '%s'", __FUNCTION__, journal_file);
+}
+
+/* restore the tabs of the session from session_init() */
+void
+session_load()
+{
+   size_t i, c, focus = 0;
+
+   replay.next_legacy = UINT64_MAX;
+   replay.focus = 0;
+   replay.gen = 0;
+   replay.journal = replay.skip = false;
+   session_replay_file(session_file);
+   /* journals without a "g" record go with snapshots without one */
+   replay.journal = true;
+   replay.skip = replay.gen > 0;
+   session_replay_file(journal_file);
+   journal.gen = replay.gen;
+
+   for (i = 0; i < replay.size; i++) {
+      if (*replay.es[i].command != '\0') {
+         c = client_add_placeholder(*replay.es[i].title != '\0'
+               ? replay.es[i].title : NULL, replay.es[i].command);
+         if (replay.es[i].id == replay.focus)
+            focus = c;
+      }
+      free(replay.es[i].title);
+      free(replay.es[i].command);
+   }
+   free(replay.es);
+   replay.es = NULL;
+   replay.size = replay.capacity = 0;
+
+   if (clients_get_size() > 0) {
+      for (c = 0; c < clients_get_size(); c++) {
+         if (c != focus && S.restore_jobs > 0)
+            session_restore_queue(c);
+      }
+      client_focus(focus);
+
+      if (restore.size > 0) {
+         restore.timer = loop_add_timer(session_restore_timeout, NULL);
+         loop_arm_timer(restore.timer, RESTORE_INTERVAL);
+      }
+   }
+
+   /* the ids on file were handles of the previous run, start afresh */
+   session_compact();
+}
+
+/* flush and compact right away, on exit; see session_compact() otherwise */
+void
+session_save()
+{
+   if (session_file == NULL)
+      return;
+
+   /* blocking is fine here, and the next process may read it right away */
+   session_compact_join();
+   compaction.again = false;
+   session_flush();
+   session_compact_format();
+   session_compact_write();
+   session_compact_apply();
+}
+
+void
+session_log_add(size_t c)
+{
+   session_log('a', client_get_handle(c), "", "");
+}
+
+void
+session_log_remove(size_t c)
+{
+   session_log('r', client_get_handle(c), NULL, NULL);
+}
+
+void
+session_log_title(size_t c)
+{
+   session_log('t', client_get_handle(c), client_get_name(c), NULL);
+}
+
+void
+session_log_command(size_t c)
+{
+   session_log('c', client_get_handle(c), client_get_command(c), NULL);
+}
+
+void
+session_log_move(size_t c)
+{
+   char pos[24];
+
+   snprintf(pos, sizeof(pos), "%zu", c);
+   session_log('m', client_get_handle(c), pos, NULL);
+}
+
+/* only the last focus before a write is recorded */
+void
+session_log_focus(size_t c)
+{
+   journal.focus = client_get_handle(c);
+   if (journal.fd != -1 && journal.focus != journal.written_focus)
+      session_save_later();
 }
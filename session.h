@@ -17,13 +17,32 @@
 #ifndef SESSION_H
 #define SESSION_H
 
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <err.h>
 
 #include "clients.h"
+#include "config.h"
+#include "discard.h"
+#include "loop.h"
 #include "xtabs.h"
 
-void session_load(const char *name);
+void session_init(const char *name);
+void session_load();
 void session_save();
+void session_compact();
+void session_save_later();
+void session_log_add(size_t c);
+void session_log_remove(size_t c);
+void session_log_title(size_t c);
+void session_log_command(size_t c);
+void session_log_move(size_t c);
+void session_log_focus(size_t c);
 
 #endif
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Clients are started by a small helper process, forked off in main()
+ * before anything else is set up.  Forking xtabs itself for every new
+ * tab would copy its page tables, however big they have grown, and hand
+ * the X connection to the child.  The helper has neither.
+ *
+ * Commands go over a socketpair, each terminated by a '\0', and are run
+ * with posix_spawnp(3) in a session of their own.  The helper answers
+ * each with the pid it started (a pid_t, 0 on failure), in order, so
+ * whoever asked can be told through a callback.  It ignores SIGCHLD so
+ * its children are reaped by the kernel, and exits once xtabs closes
+ * its end.
+ */
+
+/* sigprocmask(2) and posix_spawn(3) are POSIX, not c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include "spawner.h"
+
+extern char **environ;
+
+/* commands sent and not answered yet, oldest first */
+typedef struct {
+   spawner_cb  cb;
+   uint64_t    tag;
+} spawner_request;
+
+struct spawner_t {
+   int               fd;
+   spawner_request  *requests;
+   size_t            nrequests;
+   size_t            capacity;
+   char              buf[64 * sizeof(pid_t)];  /* partial answers */
+   size_t            len;
+};
+struct spawner_t spawner = { -1, NULL, 0, 0, { 0 }, 0 };
+
+
+pid_t
+spawner_exec(char *cmd)
+{
+   posix_spawnattr_t attr;
+   sigset_t          none, all;
+   const char       *e;
+   char            **argv;
+   short             flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+   int               argc;
+   pid_t             pid = 0;
+
+   if (str2argv(cmd, &argc, &argv, &e) != 0) {
+      warnx("%s: str2argv failed on '%s': %s", __FUNCTION__, cmd, e);
+      return 0;
+   }
+
+   sigemptyset(&none);
+   sigfillset(&all);
+
+#ifdef POSIX_SPAWN_SETSID
+   flags |= POSIX_SPAWN_SETSID;
+   posix_spawnattr_init(&attr);
+   posix_spawnattr_setflags(&attr, flags);
+   posix_spawnattr_setsigmask(&attr, &none);
+   posix_spawnattr_setsigdefault(&attr, &all);
+
+   if ((errno = posix_spawnp(&pid, argv[0], NULL, &attr, argv, environ)) != 0) {
+      warn("failed to exec '%s'", cmd);
+      pid = 0;
+   }
+   posix_spawnattr_destroy(&attr);
+#else
+   /* no way to setsid(2) through posix_spawn here, but this process is
+    * small enough for fork(2) to be cheap */
+   (void)attr; (void)flags;
+   switch (pid = fork()) {
+   case -1:
+      warn("%s: failed to fork()", __FUNCTION__);
+      pid = 0;
+      break;
+   case 0:
+      signal(SIGCHLD, SIG_DFL);
+      sigprocmask(SIG_SETMASK, &none, NULL);
+      setsid();
+      execvp(argv[0], argv);
+      warn("failed to exec '%s'", cmd);
+      _exit(127);
+   }
+#endif
+
+   argv_free(&argc, &argv);
+   return pid;
+}
+
+void
+spawner_main(int fd)
+{
+   char    buf[4096], *cmd, *end;
+   size_t  len = 0;
+   ssize_t n;
+   pid_t   pid;
+   bool    dropping = false;        /* the rest of a command too long */
+
+   signal(SIGCHLD, SIG_IGN);
+   signal(SIGINT, SIG_IGN);      /* ^C in xtabs' terminal is for xtabs */
+
+   for (;;) {
+      if ((n = read(fd, buf + len, sizeof(buf) - len)) == -1) {
+         if (errno == EINTR)
+            continue;
+         _exit(1);
+      }
+      if (n == 0)
+         _exit(0);
+      len += n;
+
+      cmd = buf;
+      while ((end = memchr(cmd, '\0', len - (cmd - buf))) != NULL) {
+         /* a dropped command still gets its answer */
+         pid = dropping ? 0 : spawner_exec(cmd);
+         dropping = false;
+         if (write(fd, &pid, sizeof(pid)) != sizeof(pid))
+            _exit(1);
+         cmd = end + 1;
+      }
+
+      len -= cmd - buf;
+      memmove(buf, cmd, len);
+      if (len == sizeof(buf)) {      /* too long, drop up to its '\0' */
+         len = 0;
+         dropping = true;
+      }
+   }
+}
+
+
+/* must run before x_init(), so the helper doesn't inherit the connection */
+void
+spawner_init()
+{
+   int fds[2];
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+      err(1, "%s: socketpair(2) failed", __FUNCTION__);
+
+   /* neither end should leak into clients */
+   fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+   fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+   switch (fork()) {
+   case -1:
+      err(1, "%s: failed to fork()", __FUNCTION__);
+   case 0:
+      close(fds[0]);
+      spawner_main(fds[1]);
+   }
+
+   close(fds[1]);
+   spawner.fd = fds[0];
+}
+
+/* the helper's answers, pids in the order the commands were sent */
+void
+spawner_recv(int fd, int ready, void *arg)
+{
+   spawner_request r;
+   pid_t           pid;
+   ssize_t         n;
+   size_t          off;
+
+   (void)ready;
+   (void)arg;
+   if ((n = read(fd, spawner.buf + spawner.len,
+         sizeof(spawner.buf) - spawner.len)) <= 0) {
+      if (n == 0 || (errno != EINTR && errno != EAGAIN))
+         loop_remove_fd(fd);
+      return;
+   }
+   spawner.len += n;
+
+   for (off = 0; spawner.len - off >= sizeof(pid_t); off += sizeof(pid_t)) {
+      memcpy(&pid, spawner.buf + off, sizeof(pid_t));
+      if (spawner.nrequests == 0)
+         continue;
+
+      r = spawner.requests[0];
+      memmove(spawner.requests, spawner.requests + 1,
+            --spawner.nrequests * sizeof(spawner_request));
+      if (r.cb != NULL)
+         r.cb(r.tag, pid);
+   }
+
+   spawner.len -= off;
+   memmove(spawner.buf, spawner.buf + off, spawner.len);
+}
+
+/* after loop_init() */
+void
+spawner_watch()
+{
+   loop_add_fd(spawner.fd, LOOP_READ, spawner_recv, NULL);
+}
+
+void
+spawner_free()
+{
+   if (spawner.fd != -1) {
+      loop_remove_fd(spawner.fd);
+      close(spawner.fd);
+   }
+   spawner.fd = -1;
+   free(spawner.requests);
+   spawner.requests = NULL;
+   spawner.nrequests = 0;
+   spawner.capacity = 0;
+   spawner.len = 0;
+}
+
+/* cb (if not NULL) gets tag and the pid once the command is started */
+void
+spawner_run(const char *cmd, spawner_cb cb, uint64_t tag)
+{
+   spawner_request *new_requests;
+   size_t           len = strlen(cmd) + 1, off = 0, new_capacity;
+   ssize_t          n;
+
+   while (off < len) {
+      if ((n = send(spawner.fd, cmd + off, len - off, MSG_NOSIGNAL)) == -1) {
+         if (errno == EINTR)
+            continue;
+         warn("%s: failed to run '%s'", __FUNCTION__, cmd);
+         return;
+      }
+      off += n;
+   }
+
+   if (spawner.nrequests == spawner.capacity) {
+      new_capacity = spawner.capacity == 0 ? 8 : spawner.capacity * 2;
+      new_requests = realloc(spawner.requests,
+            new_capacity * sizeof(spawner_request));
+      if (new_requests == NULL)
+         err(1, "%s: reallocation failed (%zd).", __FUNCTION__, new_capacity);
+      spawner.requests = new_requests;
+      spawner.capacity = new_capacity;
+   }
+   spawner.requests[spawner.nrequests].cb  = cb;
+   spawner.requests[spawner.nrequests].tag = tag;
+   spawner.nrequests++;
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Stop clients that have sat in the background for S.freeze_idle
+ * seconds, and let them run again right before they're shown.
+ *
+ * With S.freeze_cgroup set (a cgroup v2 directory delegated to us) every
+ * client with a known _NET_WM_PID gets its own child group, which is
+ * frozen through cgroup.freeze and so takes any helper processes along.
+ * Otherwise, or if that fails, the client's process group (or just the
+ * process, if it doesn't lead one) gets SIGSTOP/SIGCONT.
+ *
+ * Several clients can share a process or process group (urxvtd, any
+ * program with more than one window).  They are frozen together, only
+ * once all of them are idle, and thawed together.
+ */
+
+/* O_CLOEXEC and kill(2) are POSIX, asprintf(3) is BSD/GNU; not c99 */
+#define _GNU_SOURCE
+
+#include "suspend.h"
+
+static int suspend_timer = -1;
+
+
+bool
+suspend_write(pid_t pid, const char *file, const char *value)
+{
+   char   *path;
+   int     fd;
+   bool    ok;
+
+   if (asprintf(&path, "%s/xtabs-%d/%s", S.freeze_cgroup, (int)pid, file) == -1)
+      err(1, "%s: asprintf(3) failed", __FUNCTION__);
+
+   if ((fd = open(path, O_WRONLY | O_CLOEXEC)) == -1) {
+      free(path);
+      return false;
+   }
+
+   ok = write(fd, value, strlen(value)) == (ssize_t)strlen(value);
+   close(fd);
+   free(path);
+   return ok;
+}
+
+/* signal the process group c's pid leads, or just the pid */
+bool
+suspend_signal(size_t c, int sig)
+{
+   pid_t p = client_get_pid(c);
+
+   return kill(client_get_pgid(c) == p ? -p : p, sig) == 0;
+}
+
+/* would stopping c's processes stop d's too? */
+bool
+suspend_shared(size_t c, size_t d)
+{
+   pid_t p = client_get_pid(c), q = client_get_pid(d);
+
+   if (p == 0 || q == 0)
+      return false;
+
+   return p == q
+       || (client_get_pgid(c) != 0 && client_get_pgid(c) == client_get_pgid(d));
+}
+
+/* may c be frozen as far as c itself is concerned? */
+bool
+suspend_idle(size_t c, uint64_t now)
+{
+   if (client_is_focused(c) || client_get_pid(c) == 0)
+      return false;
+
+   if (now - client_get_last_active(c) < (uint64_t)S.freeze_idle * 1000)
+      return false;
+
+   return !config_command_listed(S.freeze_allow, S.nfreeze_allow,
+         client_get_command(c));
+}
+
+void
+suspend_check(void *arg)
+{
+   uint64_t now = loop_now();
+   size_t   c, d;
+
+   (void)arg;
+   for (c = 0; c < clients_get_size(); c++) {
+      if (client_is_frozen(c) || !suspend_idle(c, now))
+         continue;
+
+      /* everyone sharing the processes has to be idle as well */
+      for (d = 0; d < clients_get_size(); d++) {
+         if (d != c && suspend_shared(c, d) && !client_is_frozen(d)
+         &&  !suspend_idle(d, now))
+            break;
+      }
+      if (d == clients_get_size())
+         suspend_freeze(c);
+   }
+
+   loop_arm_timer(suspend_timer, S.freeze_idle * 1000 / 4 + 1000);
+}
+
+
+/* does nothing unless freeze_idle is set */
+void
+suspend_init()
+{
+   if (S.freeze_idle == 0)
+      return;
+
+   suspend_timer = loop_add_timer(suspend_check, NULL);
+   loop_arm_timer(suspend_timer, S.freeze_idle * 1000 / 4 + 1000);
+}
+
+/* called once the client's pid is known */
+void
+suspend_attach(size_t c)
+{
+   char  *path, pid[16];
+   pid_t  p = client_get_pid(c);
+
+   if (S.freeze_idle == 0 || S.freeze_cgroup == NULL || p == 0)
+      return;
+
+   if (asprintf(&path, "%s/xtabs-%d", S.freeze_cgroup, (int)p) == -1)
+      err(1, "%s: asprintf(3) failed", __FUNCTION__);
+
+   if (mkdir(path, 0755) == -1 && errno != EEXIST)
+      warn("%s: mkdir %s", __FUNCTION__, path);
+   free(path);
+
+   snprintf(pid, sizeof(pid), "%d", (int)p);
+   suspend_write(p, "cgroup.procs", pid);
+}
+
+/* a new client of processes that are already stopped is frozen too */
+void
+suspend_adopt(size_t c)
+{
+   size_t d;
+
+   for (d = 0; d < clients_get_size(); d++) {
+      if (d != c && client_is_frozen(d) && suspend_shared(c, d)) {
+         client_set_frozen(c, true);
+         return;
+      }
+   }
+}
+
+/* the group only goes away once its processes are gone, so try our best */
+void
+suspend_detach(size_t c)
+{
+   char  *path;
+   pid_t  p = client_get_pid(c);
+
+   if (S.freeze_cgroup == NULL || p == 0)
+      return;
+
+   if (asprintf(&path, "%s/xtabs-%d", S.freeze_cgroup, (int)p) == -1)
+      err(1, "%s: asprintf(3) failed", __FUNCTION__);
+
+   rmdir(path);
+   free(path);
+}
+
+/* c and every client sharing its processes, see suspend_check() */
+void
+suspend_freeze(size_t c)
+{
+   pid_t  p;
+   size_t d;
+
+   if (client_get_pid(c) == 0 || client_is_frozen(c))
+      return;
+
+   for (d = 0; d < clients_get_size(); d++) {
+      if ((d != c && !suspend_shared(c, d)) || client_is_frozen(d))
+         continue;
+
+      p = client_get_pid(d);
+      if ((S.freeze_cgroup == NULL || !suspend_write(p, "cgroup.freeze", "1"))
+      &&  !suspend_signal(d, SIGSTOP))
+         continue;
+      client_set_frozen(d, true);
+      REDRAW = true;                /* for export.c */
+   }
+}
+
+/* c and every client sharing its processes */
+void
+suspend_thaw(size_t c)
+{
+   size_t d;
+
+   if (!client_is_frozen(c))
+      return;
+
+   for (d = 0; d < clients_get_size(); d++) {
+      if ((d != c && !suspend_shared(c, d)) || !client_is_frozen(d))
+         continue;
+
+      /* whichever way it was frozen, both are harmless */
+      if (S.freeze_cgroup != NULL)
+         suspend_write(client_get_pid(d), "cgroup.freeze", "0");
+      suspend_signal(d, SIGCONT);
+      client_set_frozen(d, false);
+      REDRAW = true;                /* for export.c */
+   }
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Cache of pre-rendered tab pixmaps.  Each entry holds a server-side pixmap
+ * of one tab, keyed by everything that affects how it looks: the client
+ * (by handle, which unlike the window survives a discard), its title
+ * generation, the index label, focus state and width.
+ * A tab that hasn't changed is then a single CopyArea when the bar is
+ * repainted.  Total pixmap memory is capped and the least-recently used
+ * entries are evicted (and their pixmaps recycled) once it is exceeded.
+ */
+
+#include "tabcache.h"
+
+typedef struct {
+   xcb_pixmap_t   pixmap;
+   uint64_t       client;     /* client_handle */
+   uint32_t       gen;
+   size_t         index;
+   bool           focused;
+   uint16_t       width, height;
+   uint64_t       used;       /* LRU stamp, 0 if entry is empty */
+} tabcache_entry;
+
+struct tabcache_t {
+   tabcache_entry *es;
+   size_t          capacity;
+   size_t          bytes;      /* pixmap memory currently held */
+   size_t          max_bytes;
+   uint64_t        tick;
+};
+struct tabcache_t tabcache;
+
+
+size_t
+tabcache_entry_bytes(uint16_t width, uint16_t height)
+{
+   /* close enough for 24/32 bit visuals */
+   return (size_t)width * height * 4;
+}
+
+void
+tabcache_init(size_t max_bytes)
+{
+   static const size_t init_size = 64;
+
+   if ((tabcache.es = calloc(init_size, sizeof(tabcache_entry))) == NULL)
+      err(1, "%s: calloc(3) failed", __FUNCTION__);
+
+   tabcache.capacity = init_size;
+   tabcache.bytes = 0;
+   tabcache.max_bytes = max_bytes;
+   tabcache.tick = 0;
+}
+
+void
+tabcache_drop(tabcache_entry *e)
+{
+   if (e->used == 0)
+      return;
+
+   xcb_free_pixmap(X.connection, e->pixmap);
+   tabcache.bytes -= tabcache_entry_bytes(e->width, e->height);
+   e->used = 0;
+}
+
+void
+tabcache_free()
+{
+   tabcache_flush();
+   free(tabcache.es);
+   tabcache.es = NULL;
+   tabcache.capacity = 0;
+}
+
+/* drop everything, e.g. when colors or the bar height change */
+void
+tabcache_flush()
+{
+   size_t i;
+   for (i = 0; i < tabcache.capacity; i++)
+      tabcache_drop(&tabcache.es[i]);
+}
+
+/* drop all entries of a client, e.g. when it goes away */
+void
+tabcache_invalidate(uint64_t client)
+{
+   size_t i;
+   for (i = 0; i < tabcache.capacity; i++) {
+      if (tabcache.es[i].used != 0 && tabcache.es[i].client == client)
+         tabcache_drop(&tabcache.es[i]);
+   }
+}
+
+/*
+ * Find a free entry for a new pixmap, evicting least-recently used entries
+ * until the new one fits under the memory cap.  If an evicted entry has
+ * the right size its pixmap is handed back in *reuse instead of freed.
+ */
+tabcache_entry *
+tabcache_alloc(uint16_t width, uint16_t height, xcb_pixmap_t *reuse)
+{
+   tabcache_entry *e, *lru, *free_slot;
+   size_t          need = tabcache_entry_bytes(width, height);
+   size_t          i, new_capacity;
+
+   *reuse = XCB_NONE;
+   for (;;) {
+      lru = free_slot = NULL;
+      for (i = 0; i < tabcache.capacity; i++) {
+         e = &tabcache.es[i];
+         if (e->used == 0) {
+            if (free_slot == NULL)
+               free_slot = e;
+         } else if (lru == NULL || e->used < lru->used)
+            lru = e;
+      }
+
+      if (tabcache.bytes + need <= tabcache.max_bytes || lru == NULL)
+         break;
+
+      if (lru->width == width && lru->height == height) {
+         /* recycle the pixmap rather than free + create */
+         *reuse = lru->pixmap;
+         lru->used = 0;
+         tabcache.bytes -= need;
+         return lru;
+      }
+      tabcache_drop(lru);
+   }
+
+   if (free_slot != NULL)
+      return free_slot;
+
+   new_capacity = tabcache.capacity * 2;
+   if ((e = realloc(tabcache.es, new_capacity * sizeof(tabcache_entry))) == NULL)
+      err(1, "%s: reallocation failed (%zd).", __FUNCTION__, new_capacity);
+
+   memset(e + tabcache.capacity, 0,
+         (new_capacity - tabcache.capacity) * sizeof(tabcache_entry));
+   tabcache.es = e;
+   free_slot = &tabcache.es[tabcache.capacity];
+   tabcache.capacity = new_capacity;
+   return free_slot;
+}
+
+/*
+ * Return the pixmap for a tab.  On a hit (*hit == true) it already holds
+ * the rendered tab; otherwise the caller must render into it.
+ */
+xcb_pixmap_t
+tabcache_lookup(uint64_t client, uint32_t gen, size_t index, bool focused,
+      uint16_t width, bool *hit)
+{
+   tabcache_entry *e;
+   xcb_pixmap_t    pixmap;
+   size_t          i;
+
+   for (i = 0; i < tabcache.capacity; i++) {
+      e = &tabcache.es[i];
+      if (e->used == 0 || e->client != client)
+         continue;
+
+      /* the title changed, older renderings are useless now */
+      if (e->gen != gen) {
+         tabcache_drop(e);
+         continue;
+      }
+
+      if (e->index == index && e->focused == focused
+      &&  e->width == width && e->height == X.bar_height) {
+         e->used = ++tabcache.tick;
+         *hit = true;
+         return e->pixmap;
+      }
+   }
+
+   e = tabcache_alloc(width, X.bar_height, &pixmap);
+   if (pixmap == XCB_NONE) {
+      pixmap = xcb_generate_id(X.connection);
+      xcb_create_pixmap(X.connection, X.screen->root_depth, pixmap,
+         X.window, width, X.bar_height);
+   }
+
+   e->pixmap  = pixmap;
+   e->client  = client;
+   e->gen     = gen;
+   e->index   = index;
+   e->focused = focused;
+   e->width   = width;
+   e->height  = X.bar_height;
+   e->used    = ++tabcache.tick;
+   tabcache.bytes += tabcache_entry_bytes(width, X.bar_height);
+
+   *hit = false;
+   return pixmap;
+}
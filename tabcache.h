@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2011 Ryan Flannery <ryan.flannery@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TABCACHE_H
+#define TABCACHE_H
+
+#include <xcb/xcb.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <err.h>
+
+#include "xutil.h"
+
+void         tabcache_init(size_t max_bytes);
+void         tabcache_free();
+void         tabcache_flush();
+void         tabcache_invalidate(uint64_t client);
+xcb_pixmap_t tabcache_lookup(uint64_t client, uint32_t gen, size_t index,
+                             bool focused, uint16_t width, bool *hit);
+
+#endif
@@ -19,7 +19,6 @@
  * Major:
  *    1. figure out fatal IO error when exiting.
  *    3. figure out xembed stuff (?)
- *    4. create simple client api
  *    5. FIGURE OUT XCB ERROR HANDLING!  DAMNIT WHY ISN'T THIS DOCUMENTED!?!?
  *    6. XXX figure out how xcb parses string/text-list atom values.
  *           currently, my support for WM_COMMAND only works if it's a single
@@ -31,24 +30,40 @@
 #include <unistd.h>
 #include <err.h>
 
-#include "str2argv.h"
+#include "control.h"
+#include "export.h"
+#include "finder.h"
+#include "keys.h"
+#include "restart.h"
 #include "session.h"
+#include "spawner.h"
 #include "clients.h"
 #include "events.h"
+#include "loop.h"
 #include "xtabs.h"
+#include "tabcache.h"
 #include "xutil.h"
 
 volatile sig_atomic_t REDRAW = false;
 volatile sig_atomic_t SIG_QUIT = 0;
+volatile sig_atomic_t SIG_RESTART = 0;   /* set along with SIG_QUIT */
+bool                  REDRAW_ALL = true;   /* bar pixmap must be rebuilt */
+bool                  EXPOSED = false;     /* window lost its contents */
 
 void  signal_handler(int);
+void  redraw_timeout(void *arg);
+void  render_tab(size_t i, xcb_pixmap_t tab, uint16_t width);
+void  draw_tab(size_t i, uint16_t xoff, uint16_t width);
 void  draw_bar();
+void  draw_overflow_markers(bool copy);
 char *str_replace(const char *source, const char *old, const char *new);
 
 int main(int argc, char *argv[])
 {
    xcb_generic_event_t *e;
    char *session_name;
+   uint64_t now, last_draw = 0;
+   int redraw_timer;
 
    if (argc > 2)
       errx(1, "usage: %s [session-name]", argv[0]);
@@ -58,90 +73,110 @@ int main(int argc, char *argv[])
    else
       session_name = argv[1];
 
-   x_init();
+   x_defaults();
+   config_load();
+   spawner_init();
+   x_init(restart_init());
+   keys_init();
+   loop_init(signal_handler);
+   loop_add_signal(SIGCHLD);
+   loop_add_signal(SIGINT);
+   loop_add_signal(SIGHUP);
+   loop_add_signal(SIGQUIT);
+   loop_add_signal(SIGUSR1);
+   loop_add_fd(xcb_get_file_descriptor(X.connection), LOOP_READ, NULL, NULL);
+   spawner_watch();
+   redraw_timer = loop_add_timer(redraw_timeout, NULL);
+
+   tabcache_init(X.tab_cache_size);
    clients_init();
-   session_load(session_name);
-
-   signal(SIGCHLD, signal_handler);
-   signal(SIGINT,  signal_handler);
-   signal(SIGHUP,  signal_handler);
-   signal(SIGQUIT, signal_handler);
+   finder_init();
+   suspend_init();
+   discard_init();
+   session_init(session_name);
+   control_init(session_name);      /* refuses a session already running */
+   if (!restart_restore())
+      session_load();
+   export_init(session_name);
 
    REDRAW = true;
    while (!SIG_QUIT) {
-      e = xcb_wait_for_event(X.connection);
-      if (SIG_QUIT) break;
-
-      switch (e->response_type & ~0x80) {
-      case XCB_EXPOSE:
-         REDRAW = true;
-         break;
-      case XCB_KEY_PRESS:
-         xevent_recv_keypress((xcb_key_press_event_t*)e);
-         break;
-      case XCB_BUTTON_PRESS:
-         xevent_recv_buttonpress((xcb_button_press_event_t*)e);
-         break;
-      case XCB_CONFIGURE_NOTIFY:
-         xevent_recv_configure_notify((xcb_configure_notify_event_t*)e);
-         break;
-      case XCB_CREATE_NOTIFY:
-         xevent_recv_create_notify((xcb_create_notify_event_t*)e);
-         break;
-      case XCB_DESTROY_NOTIFY:
-         xevent_recv_destroy_notify((xcb_destroy_notify_event_t*)e);
-         break;
-      case XCB_PROPERTY_NOTIFY:
-         xevent_recv_property_notify((xcb_property_notify_event_t*)e);
-         break;
+      /* drain everything that's queued, then render & flush once */
+      while (!SIG_QUIT && (e = xcb_poll_for_event(X.connection)) != NULL) {
+         xevent_dispatch(e);
+         free(e);
       }
 
-      if (REDRAW) {
-         draw_bar();
-         xcb_flush(X.connection);
-         REDRAW = false;
+      if (SIG_QUIT) break;
+      if (xcb_connection_has_error(X.connection))
+         errx(1, "lost connection to the X server");
+
+      xevent_flush_batch();
+
+      /* throttle redraws to one per X.redraw_interval */
+      if (REDRAW && !loop_timer_armed(redraw_timer)) {
+         now = loop_now();
+         if (now - last_draw >= X.redraw_interval) {
+            draw_bar();
+            export_update();
+            REDRAW = false;
+            last_draw = now;
+         } else
+            loop_arm_timer(redraw_timer, X.redraw_interval - (now - last_draw));
+      }
+      xcb_flush(X.connection);
+
+      /* replies read above may have queued events without the socket
+       * becoming readable, so only sleep when xcb's queue is empty */
+      if ((e = xcb_poll_for_queued_event(X.connection)) != NULL) {
+         xevent_dispatch(e);
+         free(e);
+         continue;
       }
 
-      free(e);
+      loop_wait();
    }
 
+   if (SIG_RESTART)
+      restart_exec(argv);
+
+   control_free();
+   export_free();
    session_save();
    clients_free();
+   finder_free();
+   discard_free();
+   tabcache_free();
+   layout_free();
+   loop_free();
+   keys_free();
    x_free();
+   spawner_free();
    return 0;
 }
 
+/* run cmd (after replacing WINID with our window), or a new browser */
 void
 spawn(char *cmd)
 {
-   const char *e;
-   char      **argv;
-   int         argc;
-
-   switch (fork()) {
-   case -1:
-      err(1, "%s: failed to fork()", __FUNCTION__);
-   case 0:
-      break;
-   default:
-      return;
-   }
-
-   /* Child Process ... */
+   spawn_tracked(cmd, NULL, 0);
+}
 
-   if (cmd == NULL)
-      asprintf(&cmd, "vimprobable2 -e %s", X.str_window);
-   else
+/* same, cb gets tag and the pid it was started as */
+void
+spawn_tracked(char *cmd, spawner_cb cb, uint64_t tag)
+{
+   if (cmd == NULL) {
+      if (asprintf(&cmd, "vimprobable2 -e %s", X.str_window) == -1)
+         err(1, "%s: asprintf(3) failed", __FUNCTION__);
+   } else
       cmd = str_replace(cmd, "WINID", X.str_window);
 
-   if (str2argv(cmd, &argc, &argv, &e) != 0)
-      errx(1, "%s: str2argv failed on '%s': %s", __FUNCTION__, cmd, e);
-
-   setsid();
-   execvp(argv[0], (char**)argv);
-   err(1, "failed to exec '%s'", cmd);
+   spawner_run(cmd, cb, tag);
+   free(cmd);
 }
 
+/* called from loop_wait(), not asynchronously */
 void
 signal_handler(int sig)
 {
@@ -151,74 +186,192 @@ signal_handler(int sig)
    case SIGQUIT:
       SIG_QUIT = 1;
       break;
+   case SIGUSR1:
+      SIG_RESTART = 1;
+      SIG_QUIT = 1;
+      break;
    case SIGCHLD:
       while(0 < waitpid(-1, NULL, WNOHANG));
       break;
    }
 }
+
+void
+redraw_timeout(void *arg)
+{
+   /* nothing to do: waking the loop with REDRAW still set redraws */
+   (void)arg;
+}
  
 void
-draw_bar()
+render_tab(size_t i, xcb_pixmap_t tab, uint16_t width)
 {
-   /* TODO replace asprintf with snpritnf to a fixed pad */
-   xcb_rectangle_t whole_window = { 0, 0, X.width, X.height };
-   xcb_rectangle_t whole_tab = { 0, 0, X.tab_width, X.bar_height };
+   xcb_rectangle_t whole_tab = { 0, 0, width, X.bar_height };
    xcb_gcontext_t  gc_fg, gc_bg;
-   xcb_point_t     p[2];
-   uint16_t        xoff = 0;
    int32_t         num_width;
-   size_t          i;
-   char           *num;
+   const char     *name;
+   size_t          name_len;
+   char            num[24];
+   int             num_len;
+
+   if (client_is_focused(i)) {
+      gc_fg = X.gc_bar_curr_fg;
+      gc_bg = X.gc_bar_curr_bg;
+   } else {
+      gc_fg = X.gc_bar_norm_fg;
+      gc_bg = X.gc_bar_norm_bg;
+   }
 
-   xcb_poly_fill_rectangle(X.connection, X.bar, X.gc_bar_norm_bg, 1, &whole_window);
+   num_len = snprintf(num, sizeof(num), "%zd: ", i);
+   num_width = x_get_strnwidth(num, num_len);
+
+   /* truncate the title to what fits inside the tab */
+   name = client_get_name(i);
+   name_len = x_get_strfit(name, client_get_name_len(i),
+         width - num_width - 2 * (X.font_padding + 1));
+
+   xcb_poly_fill_rectangle(X.connection, tab, gc_bg, 1, &whole_tab);
+   xcb_image_text_8(X.connection,
+                    num_len,
+                    tab,
+                    gc_fg,
+                    X.font_padding + 1,
+                    X.bar_height - (X.font_descent + X.font_padding + 1),
+                    num);
+   xcb_image_text_8(X.connection,
+                    name_len,
+                    tab,
+                    gc_fg,
+                    X.font_padding + 1 + num_width,
+                    X.bar_height - (X.font_descent + X.font_padding + 1),
+                    name);
+   xcb_poly_rectangle(X.connection, tab, X.gc_bar_border, 1, &whole_tab);
+}
 
-   for (i = clients_get_offset(); i < clients_get_size() && xoff <= X.width; i++) {
+/* copy tab i into the bar, rendering it first unless it's cached */
+void
+draw_tab(size_t i, uint16_t xoff, uint16_t width)
+{
+   xcb_pixmap_t tab;
+   bool         hit;
+
+   tab = tabcache_lookup(client_get_handle(i), client_get_name_gen(i), i,
+         client_is_focused(i), width, &hit);
+   if (!hit)
+      render_tab(i, tab, width);
+
+   xcb_copy_area(X.connection, tab, X.bar, X.gc_bar_norm_bg,
+      0, 0, xoff, 0, width, X.bar_height);
+}
+
+/*
+ * Repaint the tab bar.  Only tabs flagged dirty are rasterized, and only
+ * their rectangles are copied to the window.  REDRAW_ALL forces every
+ * visible tab (and the empty space after the last one) to be repainted,
+ * while EXPOSED just re-copies the existing bar pixmap to the window.
+ */
+void
+draw_bar()
+{
+   static int32_t  last_xoff = -1;
+   static bool     last_left = false, last_right = false;
+   xcb_rectangle_t rest;
+   xcb_point_t     p[2];
+   uint16_t        xoff = 0, width;
+   size_t          i;
+   bool            drawn = false;
+
+   /* the finder has the whole bar while it's open */
+   if (finder_active()) {
+      finder_draw();
+      return;
+   }
 
-      if (client_is_focused(i)) {
-         gc_fg = X.gc_bar_curr_fg;
-         gc_bg = X.gc_bar_curr_bg;
-      } else {
-         gc_fg = X.gc_bar_norm_fg;
-         gc_bg = X.gc_bar_norm_bg;
+   layout_update();
+   clients_settle();
+
+   /* markers are painted over tabs that may not be dirty */
+   if (last_left != clients_hidden_left() || last_right != clients_hidden_right())
+      REDRAW_ALL = true;
+   last_left  = clients_hidden_left();
+   last_right = clients_hidden_right();
+
+   /* only tabs in the viewport are ever touched */
+   for (i = clients_get_offset(); i < clients_get_size() && xoff < X.width; i++) {
+      width = layout_get_width(i);
+      if (REDRAW_ALL || client_is_dirty(i)) {
+         drawn = true;
+         draw_tab(i, xoff, width);
+         if (!REDRAW_ALL && !EXPOSED)
+            xcb_copy_area(X.connection, X.bar, X.window, X.gc_bar_norm_bg,
+               xoff, 0, xoff, 0, width, X.bar_height);
       }
+      client_clear_dirty(i);
+      xoff += width;
+   }
 
-      if (asprintf(&num, "%zd: ", i) == -1)
-         err(1, "%s: asprintf(3) num failed", __FUNCTION__);
-
-      num_width = x_get_strwidth(num);
-
-      xcb_poly_fill_rectangle(X.connection, X.tab, gc_bg, 1, &whole_tab);
-      xcb_image_text_8(X.connection,
-                       strlen(num),
-                       X.tab,
-                       gc_fg,
-                       X.font_padding + 1,
-                       X.bar_height - (X.font_descent + X.font_padding + 1),
-                       num);
-      xcb_image_text_8(X.connection,
-                       strlen(client_get_name(i)),
-                       X.tab,
-                       gc_fg,
-                       X.font_padding + 1 + num_width,
-                       X.bar_height - (X.font_descent + X.font_padding + 1),
-                       client_get_name(i));
-      xcb_poly_rectangle(X.connection, X.tab, X.gc_bar_border, 1, &whole_tab);
-      xcb_copy_area(X.connection, X.tab, X.bar, X.gc_bar_norm_bg,
-         0, 0, xoff, 0, X.tab_width, X.bar_height);
-
-      xoff += X.tab_width;
-      free(num);
+   /* space after the last tab changed (tab added/removed or resize) */
+   if (REDRAW_ALL || xoff != last_xoff) {
+      rest.x = xoff;
+      rest.y = 0;
+      rest.width = X.width > xoff ? X.width - xoff : 0;
+      rest.height = X.bar_height;
+      xcb_poly_fill_rectangle(X.connection, X.bar, X.gc_bar_norm_bg, 1, &rest);
+
+      p[0].x = xoff;
+      p[0].y = 0;
+      p[1].x = xoff;
+      p[1].y = X.bar_height;
+      xcb_poly_line(X.connection, XCB_COORD_MODE_ORIGIN, X.bar, X.gc_bar_border,
+            2, p);
+
+      if (!REDRAW_ALL && !EXPOSED)
+         xcb_copy_area(X.connection, X.bar, X.window, X.gc_bar_norm_bg,
+            xoff, 0, xoff, 0, rest.width + 1, X.bar_height);
+      last_xoff = xoff;
+      drawn = true;
    }
 
-   p[0].x = xoff;
-   p[0].y = 0;
-   p[1].x = xoff;
-   p[1].y = X.bar_height;
-   xcb_poly_line(X.connection, XCB_COORD_MODE_ORIGIN, X.bar, X.gc_bar_border,
-         2, p);
+   /* repainted tabs may have covered the markers */
+   if (drawn)
+      draw_overflow_markers(!REDRAW_ALL && !EXPOSED);
+
+   if (REDRAW_ALL || EXPOSED)
+      xcb_copy_area(X.connection, X.bar, X.window, X.gc_bar_norm_bg,
+         0, 0, 0, 0, X.width, X.bar_height);
 
-   xcb_copy_area(X.connection, X.bar, X.window, X.gc_bar_norm_bg,
-      0, 0, 0, 0, X.width, X.height);
+   REDRAW_ALL = false;
+   EXPOSED = false;
+}
+
+/*
+ * Small arrows at the edges of the bar when tabs are scrolled out of view
+ * on that side.  If copy is set the marker areas are copied to the window.
+ */
+void
+draw_overflow_markers(bool copy)
+{
+   int16_t     w = X.bar_height / 2;
+   int16_t     h = X.bar_height;
+   xcb_point_t left[3]  = { { 1, h / 2 }, { w, 2 }, { w, h - 2 } };
+   xcb_point_t right[3] = { { X.width - 2, h / 2 }, { X.width - w - 1, 2 },
+                            { X.width - w - 1, h - 2 } };
+
+   if (clients_hidden_left()) {
+      xcb_fill_poly(X.connection, X.bar, X.gc_bar_curr_fg,
+            XCB_POLY_SHAPE_CONVEX, XCB_COORD_MODE_ORIGIN, 3, left);
+      if (copy)
+         xcb_copy_area(X.connection, X.bar, X.window, X.gc_bar_norm_bg,
+            0, 0, 0, 0, w + 1, h);
+   }
+
+   if (clients_hidden_right()) {
+      xcb_fill_poly(X.connection, X.bar, X.gc_bar_curr_fg,
+            XCB_POLY_SHAPE_CONVEX, XCB_COORD_MODE_ORIGIN, 3, right);
+      if (copy)
+         xcb_copy_area(X.connection, X.bar, X.window, X.gc_bar_norm_bg,
+            X.width - w - 1, 0, X.width - w - 1, 0, w + 1, h);
+   }
 }
 
 char*
@@ -17,9 +17,18 @@
 #ifndef XTABS_H
 #define XTABS_H
 
+#include <signal.h>
+#include <stdbool.h>
+
+#include "spawner.h"
+
 extern volatile sig_atomic_t REDRAW;
 extern volatile sig_atomic_t SIG_QUIT;
+extern volatile sig_atomic_t SIG_RESTART;
+extern bool REDRAW_ALL;
+extern bool EXPOSED;
 
 void spawn(char *cmd);
+void spawn_tracked(char *cmd, spawner_cb cb, uint64_t tag);
 
 #endif
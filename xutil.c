@@ -18,19 +18,59 @@
 
 xinfo X;
 
+/* settings, must be called before x_init() */
 void
-x_init()
+x_defaults()
 {
-   xcb_query_font_reply_t *font_reply;
-   uint32_t                mask;
-   uint32_t                values[2];
-   char                   *font_name = "fixed";
-
    /* TODO Eventually these will be settings & storable */
    X.width = 100;
    X.height = 100;
    X.tab_width = 100;
+   X.tab_min_width = 60;
+   X.tab_max_width = 200;
+   X.tab_layout = LAYOUT_FIXED;
+   X.tab_cache_size = 2 * 1024 * 1024;
+   X.redraw_interval = 16;
+   X.scroll_policy = SCROLL_MINIMAL;
+   X.hide_mode = HIDE_RAISE;
    X.font_padding = 1;
+   X.color_norm_fg = "#999999";
+   X.color_norm_bg = "#171717";
+   X.color_curr_fg = "#ff0000";
+   X.color_curr_bg = "#000000";
+   X.color_border  = "#000000";
+}
+
+/*
+ * Connect and set up our window.  If reuse is set, it is the window a
+ * previous xtabs kept alive across a restart (see restart.c), with the
+ * clients still inside it, and is taken over instead.
+ */
+void
+x_init(xcb_window_t reuse)
+{
+   xcb_get_geometry_cookie_t geometry_cookie;
+   xcb_get_geometry_reply_t *geometry;
+   xcb_query_font_cookie_t font_cookie;
+   xcb_intern_atom_cookie_t pid_cookie;
+   xcb_intern_atom_reply_t *atom_reply;
+   xcb_query_font_reply_t *font_reply;
+   uint32_t                mask;
+   uint32_t                values[2];
+   char                   *font_name = "fixed";
+   size_t                  i;
+   struct {
+      const char     *fg_name, *bg_name;
+      xcolor          fg, bg;
+      xcb_gcontext_t *gc;
+   } gcs[] = {
+      { X.color_norm_fg, X.color_norm_bg, {0}, {0}, &X.gc_bar_norm_fg },
+      { X.color_norm_bg, X.color_norm_bg, {0}, {0}, &X.gc_bar_norm_bg },
+      { X.color_curr_fg, X.color_curr_bg, {0}, {0}, &X.gc_bar_curr_fg },
+      { X.color_curr_bg, X.color_curr_bg, {0}, {0}, &X.gc_bar_curr_bg },
+      { X.color_border,  X.color_border,  {0}, {0}, &X.gc_bar_border  }
+   };
+   const size_t ngcs = sizeof(gcs) / sizeof(gcs[0]);
 
    /* setup connection, screen, colormap */
    X.connection = xcb_connect(NULL,NULL);
@@ -39,9 +79,9 @@ x_init()
 
    X.screen = xcb_setup_roots_iterator( xcb_get_setup(X.connection) ).data;
    X.colormap = X.screen->default_colormap;
+   X.visual = x_find_visual(X.screen->root_visual);
 
    /* setup window and string-form of window-id */
-   X.window = xcb_generate_id(X.connection);
    mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
    values[0] = X.screen->white_pixel;
    values[1] = XCB_EVENT_MASK_EXPOSURE
@@ -51,72 +91,115 @@ x_init()
              | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY
              | XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT;
 
-   xcb_create_window(X.connection, X.screen->root_depth,
-      X.window, X.screen->root,
-      0, 0, X.width, X.height, 1,
-      XCB_WINDOW_CLASS_INPUT_OUTPUT,
-      X.screen->root_visual,
-      mask, values);
+   if (reuse != XCB_NONE) {
+      /* event selections went away with the old connection */
+      X.window = reuse;
+      xcb_change_window_attributes(X.connection, X.window, mask, values);
+      geometry_cookie = xcb_get_geometry(X.connection, X.window);
+   } else {
+      X.window = xcb_generate_id(X.connection);
+      xcb_create_window(X.connection, X.screen->root_depth,
+         X.window, X.screen->root,
+         0, 0, X.width, X.height, 1,
+         XCB_WINDOW_CLASS_INPUT_OUTPUT,
+         X.screen->root_visual,
+         mask, values);
+   }
 
    if (asprintf(&X.str_window, "%d", X.window) == -1)
       errx(1, "failed to asprintf(3) window id");
 
-   /* load font */
+   /* Startup is pipelined: the font query and every color allocation are
+    * sent before waiting on any reply, so it costs one round trip.  On
+    * TrueColor visuals "#rrggbb" colors don't need the server at all.
+    */
    X.font = xcb_generate_id(X.connection);
    xcb_open_font(X.connection, X.font, strlen(font_name), font_name);
+   font_cookie = xcb_query_font(X.connection, X.font);
+   pid_cookie = xcb_intern_atom(X.connection, 0, strlen("_NET_WM_PID"), "_NET_WM_PID");
+
+   for (i = 0; i < ngcs; i++) {
+      x_request_color(&gcs[i].fg, gcs[i].fg_name);
+      x_request_color(&gcs[i].bg, gcs[i].bg_name);
+   }
+
+   font_reply = xcb_query_font_reply(X.connection, font_cookie, NULL);
+   if (!font_reply)
+      errx(1, "%s: failed to query font '%s'", __FUNCTION__, font_name);
 
-   font_reply = xcb_query_font_reply(X.connection,
-         xcb_query_font(X.connection, X.font),
-         NULL);
    X.font_ascent  = font_reply->font_ascent;
    X.font_descent = font_reply->font_descent;
    X.bar_height = 2 + X.font_ascent + X.font_descent + 2 * X.font_padding;
-
-   /* normal tab gc's */
-   X.gc_bar_norm_fg = xcb_generate_id(X.connection);
-   X.gc_bar_norm_bg = xcb_generate_id(X.connection);
-   X.gc_bar_norm_fg = x_load_gc("gray60", "gray9");
-   X.gc_bar_norm_bg = x_load_gc("gray9",  "gray9");
-
-   /* current tab gc's */
-   X.gc_bar_curr_fg = xcb_generate_id(X.connection);
-   X.gc_bar_curr_bg = xcb_generate_id(X.connection);
-   X.gc_bar_curr_fg = x_load_gc("red",   "black");
-   X.gc_bar_curr_bg = x_load_gc("black", "black");
-
-   /* border gc */
-   X.gc_bar_border = xcb_generate_id(X.connection);
-   X.gc_bar_border = x_load_gc("black", "black");
-
-   /* bar & tab pixmap's */
+   x_load_font_metrics(font_reply);
+   free(font_reply);
+
+   if ((atom_reply = xcb_intern_atom_reply(X.connection, pid_cookie, NULL)) == NULL)
+      errx(1, "%s: failed to intern _NET_WM_PID", __FUNCTION__);
+   X.atom_net_wm_pid = atom_reply->atom;
+   free(atom_reply);
+
+   if (reuse != XCB_NONE) {
+      if ((geometry = xcb_get_geometry_reply(X.connection, geometry_cookie, NULL)) == NULL)
+         errx(1, "%s: window %x to take over is gone", __FUNCTION__, reuse);
+      X.width  = geometry->width;
+      X.height = geometry->height;
+      free(geometry);
+   }
+
+   for (i = 0; i < ngcs; i++) {
+      x_get_color_reply(&gcs[i].fg);
+      x_get_color_reply(&gcs[i].bg);
+      *gcs[i].gc = x_create_gc(gcs[i].fg.pixel, gcs[i].bg.pixel);
+   }
+
+   /* bar pixmap (tabs are rendered into the tabcache's pixmaps) */
    X.bar = xcb_generate_id(X.connection);
-   X.tab = xcb_generate_id(X.connection);
-
+   X.bar_width = X.width > X.screen->width_in_pixels ?
+      X.width : X.screen->width_in_pixels;
    xcb_create_pixmap(X.connection, X.screen->root_depth, X.bar,
-      X.window, X.width, X.bar_height);
-   xcb_create_pixmap(X.connection, X.screen->root_depth, X.tab,
-      X.window, X.tab_width, X.bar_height);
+      X.window, X.bar_width, X.bar_height);
 
    xcb_map_window(X.connection, X.window);
    xcb_flush(X.connection);
 }
 
 void
-x_free()
+x_free_resources()
 {
    xcb_free_pixmap(X.connection, X.bar);
-   xcb_free_pixmap(X.connection, X.tab);
    xcb_free_gc(X.connection, X.gc_bar_norm_fg);
    xcb_free_gc(X.connection, X.gc_bar_norm_bg);
    xcb_free_gc(X.connection, X.gc_bar_curr_fg);
    xcb_free_gc(X.connection, X.gc_bar_curr_bg);
    xcb_free_gc(X.connection, X.gc_bar_border);
    xcb_close_font(X.connection, X.font);
+   free(X.font_widths);
+}
+
+void
+x_free()
+{
+   x_free_resources();
    xcb_destroy_window(X.connection, X.window);
    xcb_disconnect(X.connection);
    free(X.str_window);
 }
 
+/*
+ * Disconnect but keep our window, and so the clients inside it, alive
+ * for the next xtabs to x_init() with.  Everything else is freed first
+ * since retained resources only go away with the server.
+ */
+void
+x_detach()
+{
+   x_free_resources();
+   xcb_set_close_down_mode(X.connection, XCB_CLOSE_DOWN_RETAIN_TEMPORARY);
+   xcb_flush(X.connection);
+   xcb_disconnect(X.connection);
+   free(X.str_window);
+}
+
 void
 x_set_window_name(const char *name, xcb_window_t w)
 {
@@ -131,13 +214,10 @@ x_set_window_name(const char *name, xcb_window_t w)
 char*
 x_get_window_name(xcb_window_t w)
 {
-   xcb_get_property_cookie_t c;
    xcb_get_text_property_reply_t reply;
-   xcb_generic_error_t *err;
    char *name;
 
-   c = xcb_get_text_property(X.connection, w, WM_NAME);
-   if (xcb_get_text_property_reply(X.connection, c, &reply, &err) == 0)
+   if (!x_get_text_property_reply(x_request_text_property(w, WM_NAME), &reply))
       errx(1, "failed to get window property");
 
    name = strndup(reply.name, reply.name_len);
@@ -152,13 +232,10 @@ x_get_command(xcb_window_t w)
     * Can't figure out with xcb how to get access to these.... (the below
     * only gives the first string, argv[0]).
     */
-   xcb_get_property_cookie_t c;
    xcb_get_text_property_reply_t reply;
-   xcb_generic_error_t *err;
    char *name;
 
-   c = xcb_get_text_property(X.connection, w, WM_COMMAND);
-   if (xcb_get_text_property_reply(X.connection, c, &reply, &err) == 0)
+   if (!x_get_text_property_reply(x_request_text_property(w, WM_COMMAND), &reply))
       errx(1, "failed to get window property");
 
    name = strndup(reply.name, reply.name_len);
@@ -166,24 +243,210 @@ x_get_command(xcb_window_t w)
    return name;
 }
 
+/*
+ * Property fetches are split in two so callers can send a whole batch of
+ * requests before waiting on the first reply.
+ */
+xcb_get_property_cookie_t
+x_request_text_property(xcb_window_t w, xcb_atom_t a)
+{
+   return xcb_get_text_property(X.connection, w, a);
+}
+
+xcb_get_property_cookie_t
+x_request_pid(xcb_window_t w)
+{
+   return xcb_get_property(X.connection, 0, w, X.atom_net_wm_pid,
+         XCB_ATOM_CARDINAL, 0, 1);
+}
+
+/* false if the window is gone or hasn't set _NET_WM_PID */
+bool
+x_get_pid_reply(xcb_get_property_cookie_t c, uint32_t *pid)
+{
+   xcb_get_property_reply_t *reply;
+   bool                      ok = false;
+
+   if ((reply = xcb_get_property_reply(X.connection, c, NULL)) == NULL)
+      return false;
+
+   if (reply->format == 32 && xcb_get_property_value_length(reply) == 4) {
+      *pid = *(uint32_t*)xcb_get_property_value(reply);
+      ok = true;
+   }
+
+   free(reply);
+   return ok;
+}
+
+/*
+ * Is a WM_CLIENT_MACHINE value this host?  Either side may or may not be
+ * fully qualified, so "host" and "host.example.org" are the same.
+ */
+bool
+x_is_local_host(const char *name, size_t len)
+{
+   static char host[256];
+   size_t      n;
+
+   if (host[0] == '\0' && gethostname(host, sizeof(host) - 1) == -1)
+      return true;
+
+   n = strlen(host);
+   if (len > n)
+      return strncmp(name, host, n) == 0 && name[n] == '.';
+   if (len < n)
+      return strncmp(name, host, len) == 0 && host[len] == '.';
+   return strncmp(name, host, n) == 0;
+}
+
+/*
+ * Which X connection created window w.  Resource ids carry the client's
+ * id in the bits outside the server's id mask, and xcb_kill_client()
+ * takes down everything of that client.
+ */
+uint32_t
+x_client_id(xcb_window_t w)
+{
+   return w & ~xcb_get_setup(X.connection)->resource_id_mask;
+}
+
+/*
+ * false if the request failed, e.g. because the window is gone by now.
+ * On success reply->name (not NUL-terminated) is valid until the reply
+ * is wiped with xcb_get_text_property_reply_wipe().
+ */
+bool
+x_get_text_property_reply(xcb_get_property_cookie_t c,
+      xcb_get_text_property_reply_t *reply)
+{
+   xcb_generic_error_t *err;
+
+   if (xcb_get_text_property_reply(X.connection, c, reply, &err) == 0) {
+      free(err);
+      return false;
+   }
+   return true;
+}
+
+/*
+ * Advance of glyph byte1/byte2, false if the font doesn't have it.  The
+ * char infos are a (max_byte1 - min_byte1 + 1) by (max_byte2 - min_byte2
+ * + 1) matrix, and all-zero metrics mark a missing glyph.
+ */
+bool
+x_font_charwidth(xcb_query_font_reply_t *r, uint8_t byte1, uint8_t byte2,
+      int16_t *width)
+{
+   xcb_charinfo_t *ci;
+   size_t          i;
+   int             len;
+
+   if (byte1 < r->min_byte1 || byte1 > r->max_byte1
+   ||  byte2 < r->min_char_or_byte2 || byte2 > r->max_char_or_byte2)
+      return false;
+
+   /* no per-char info means every glyph has the max bounds */
+   ci  = xcb_query_font_char_infos(r);
+   len = xcb_query_font_char_infos_length(r);
+   if (len == 0) {
+      *width = r->max_bounds.character_width;
+      return true;
+   }
+
+   i = (size_t)(byte1 - r->min_byte1)
+     * (r->max_char_or_byte2 - r->min_char_or_byte2 + 1)
+     + (byte2 - r->min_char_or_byte2);
+   if (i >= (size_t)len)
+      return false;
+
+   ci += i;
+   if (ci->character_width == 0 && ci->left_side_bearing == 0
+   &&  ci->right_side_bearing == 0 && ci->ascent == 0 && ci->descent == 0
+   &&  ci->attributes == 0)
+      return false;
+
+   *width = ci->character_width;
+   return true;
+}
+
+/*
+ * Build the client-side advance-width table from a QueryFont reply so
+ * string widths never need a QueryTextExtents round trip.  ImageText8
+ * draws byte c as glyph 0/c, so only that row of a two-byte font is kept.
+ * Missing glyphs are drawn as default_char, or take the max bounds if
+ * the font doesn't have that either.
+ */
+void
+x_load_font_metrics(xcb_query_font_reply_t *r)
+{
+   size_t  i, n;
+   int16_t width;
+
+   if (!x_font_charwidth(r, r->default_char >> 8, r->default_char & 0xff,
+         &X.font_default_width))
+      X.font_default_width = r->max_bounds.character_width;
+
+   X.font_min_char = r->min_char_or_byte2 > 255 ? 255 : r->min_char_or_byte2;
+   X.font_max_char = r->max_char_or_byte2 > 255 ? 255 : r->max_char_or_byte2;
+   if (X.font_max_char < X.font_min_char)
+      X.font_max_char = X.font_min_char;
+
+   n = X.font_max_char - X.font_min_char + 1;
+   if ((X.font_widths = calloc(n, sizeof(int16_t))) == NULL)
+      err(1, "%s: calloc(3) failed", __FUNCTION__);
+
+   for (i = 0; i < n; i++) {
+      if (x_font_charwidth(r, 0, X.font_min_char + i, &width))
+         X.font_widths[i] = width;
+      else
+         X.font_widths[i] = X.font_default_width;
+   }
+}
+
+int16_t
+x_get_charwidth(unsigned char c)
+{
+   if (c < X.font_min_char || c > X.font_max_char)
+      return X.font_default_width;
+
+   return X.font_widths[c - X.font_min_char];
+}
+
 int32_t
 x_get_strwidth(const char *s)
 {
-   xcb_query_text_extents_reply_t *reply;
-   int32_t w;
+   return x_get_strnwidth(s, strlen(s));
+}
 
-   reply = xcb_query_text_extents_reply(X.connection,
-         xcb_query_text_extents(X.connection, X.font, strlen(s), (xcb_char2b_t*)s),
-         NULL);
-   if (!reply)
-      errx(1, "xcb_query_text_extents failed");
+int32_t
+x_get_strnwidth(const char *s, size_t len)
+{
+   int32_t w = 0;
+   size_t  i;
 
-   w = reply->overall_width;
-   free(reply);
+   for (i = 0; i < len; i++)
+      w += x_get_charwidth(s[i]);
 
    return w;
 }
 
+/* number of leading bytes of s that fit within width pixels */
+size_t
+x_get_strfit(const char *s, size_t len, int32_t width)
+{
+   int32_t w = 0;
+   size_t  i;
+
+   for (i = 0; i < len; i++) {
+      w += x_get_charwidth(s[i]);
+      if (w > width)
+         break;
+   }
+
+   return i;
+}
+
 xcb_alloc_color_reply_t*
 x_load_color(uint16_t r, uint16_t g, uint16_t b)
 {
@@ -212,28 +475,108 @@ x_load_strcolor(const char *name)
    return c;
 }
 
+/* root visual's type, used to compute TrueColor pixels locally */
+xcb_visualtype_t*
+x_find_visual(xcb_visualid_t id)
+{
+   xcb_depth_iterator_t  d;
+   xcb_visualtype_iterator_t v;
+
+   for (d = xcb_screen_allowed_depths_iterator(X.screen); d.rem; xcb_depth_next(&d)) {
+      for (v = xcb_depth_visuals_iterator(d.data); v.rem; xcb_visualtype_next(&v)) {
+         if (v.data->visual_id == id)
+            return v.data;
+      }
+   }
+   return NULL;
+}
+
+/* scale an 8-bit color component into the bits of a visual's mask */
+uint32_t
+x_scale_to_mask(uint8_t value, uint32_t mask)
+{
+   int shift = 0, bits = 0;
+
+   if (mask == 0)
+      return 0;
+
+   while (!(mask & 1)) { mask >>= 1; shift++; }
+   while (mask & 1)    { mask >>= 1; bits++; }
+
+   if (bits >= 8)
+      return ((uint32_t)value << (bits - 8)) << shift;
+   else
+      return ((uint32_t)value >> (8 - bits)) << shift;
+}
+
+/*
+ * Start resolving a color.  "#rrggbb" on a TrueColor visual is computed
+ * right away, anything else sends an AllocNamedColor whose reply is
+ * collected later by x_get_color_reply().
+ */
+void
+x_request_color(xcolor *c, const char *name)
+{
+   unsigned int r, g, b;
+
+   c->name = name;
+   if (X.visual != NULL && X.visual->_class == XCB_VISUAL_CLASS_TRUE_COLOR
+   &&  strlen(name) == 7 && sscanf(name, "#%2x%2x%2x", &r, &g, &b) == 3) {
+      c->pixel = x_scale_to_mask(r, X.visual->red_mask)
+               | x_scale_to_mask(g, X.visual->green_mask)
+               | x_scale_to_mask(b, X.visual->blue_mask);
+      c->pending = false;
+      return;
+   }
+
+   c->cookie = xcb_alloc_named_color(X.connection, X.colormap, strlen(name), name);
+   c->pending = true;
+}
+
+void
+x_get_color_reply(xcolor *c)
+{
+   xcb_alloc_named_color_reply_t *reply;
+
+   if (!c->pending)
+      return;
+
+   reply = xcb_alloc_named_color_reply(X.connection, c->cookie, NULL);
+   if (!reply)
+      errx(1, "failed to parse color '%s'", c->name);
+
+   c->pixel = reply->pixel;
+   c->pending = false;
+   free(reply);
+}
+
 xcb_gcontext_t
-x_load_gc(const char *fg, const char *bg)
+x_create_gc(uint32_t fg, uint32_t bg)
 {
-   xcb_alloc_named_color_reply_t *color_fg, *color_bg;
    xcb_gcontext_t                 gc;
    uint32_t                       mask;
    uint32_t                       values[4];
 
-   color_fg = x_load_strcolor(fg);
-   color_bg = x_load_strcolor(bg);
-
    gc = xcb_generate_id(X.connection);
    mask = XCB_GC_FOREGROUND | XCB_GC_BACKGROUND | XCB_GC_FONT | XCB_GC_GRAPHICS_EXPOSURES;
-   values[0] = color_fg->pixel;
-   values[1] = color_bg->pixel;
+   values[0] = fg;
+   values[1] = bg;
    values[2] = X.font;
    values[3] = 0;
 
    xcb_create_gc(X.connection, gc, X.screen->root, mask, values);
+   return gc;
+}
+
+xcb_gcontext_t
+x_load_gc(const char *fg, const char *bg)
+{
+   xcolor color_fg, color_bg;
 
-   free(color_fg);
-   free(color_bg);
+   x_request_color(&color_fg, fg);
+   x_request_color(&color_bg, bg);
+   x_get_color_reply(&color_fg);
+   x_get_color_reply(&color_bg);
 
-   return gc;
+   return x_create_gc(color_fg.pixel, color_bg.pixel);
 }
@@ -21,41 +21,97 @@
 #include <xcb/xcb_icccm.h>
 #include <xcb/xcb_atom.h>
 
+#include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 #include <err.h>
 
+typedef enum {
+   SCROLL_MINIMAL,   /* scroll only as far as needed to show focus */
+   SCROLL_CENTER     /* keep the focused tab centered */
+} scroll_policy;
+
+typedef enum {
+   LAYOUT_FIXED,     /* every tab is tab_width wide */
+   LAYOUT_FIT,       /* fit each title, within tab_min/max_width */
+   LAYOUT_SHARED     /* split the bar evenly, within tab_min/max_width */
+} tab_layout;
+
+typedef enum {
+   HIDE_RAISE,       /* background tabs stay mapped under the focused one */
+   HIDE_UNMAP        /* background tabs are unmapped */
+} hide_mode;
+
+typedef struct {
+   const char                      *name;
+   uint32_t                         pixel;
+   bool                             pending; /* waiting on the server */
+   xcb_alloc_named_color_cookie_t   cookie;
+} xcolor;
+
 typedef struct {
    xcb_connection_t  *connection;
    xcb_screen_t      *screen;
    xcb_colormap_t     colormap;
+   xcb_visualtype_t  *visual;
    xcb_window_t       window;
    char              *str_window; /* string form of window id */
 
    uint16_t           width, height, bar_height, tab_width;
+   uint16_t           tab_min_width, tab_max_width;
+   tab_layout         tab_layout;
+   size_t             tab_cache_size; /* bytes of pre-rendered tabs */
+   uint32_t           redraw_interval; /* min msec between redraws */
+   scroll_policy      scroll_policy;
+   hide_mode          hide_mode;
    uint16_t           font_ascent, font_descent, font_padding;
    xcb_pixmap_t       bar;
-   xcb_pixmap_t       tab;
+   uint16_t           bar_width;  /* allocated width of the bar pixmap */
    xcb_font_t         font;
+   xcb_atom_t         atom_net_wm_pid;
+   int16_t           *font_widths; /* advance per char, min..max_char */
+   uint16_t           font_min_char, font_max_char;
+   int16_t            font_default_width;
 
    xcb_gcontext_t     gc_bar_norm_fg, gc_bar_norm_bg;
    xcb_gcontext_t     gc_bar_curr_fg, gc_bar_curr_bg;
    xcb_gcontext_t     gc_bar_border;
+
+   const char        *color_norm_fg, *color_norm_bg;
+   const char        *color_curr_fg, *color_curr_bg;
+   const char        *color_border;
 } xinfo;
 extern xinfo X;
 
 
-void     x_init();
+void     x_defaults();
+void     x_init(xcb_window_t reuse);
 void     x_free();
+void     x_detach();
+void     x_load_font_metrics(xcb_query_font_reply_t *r);
 
 void     x_set_window_name(const char *name, xcb_window_t);
 char*    x_get_window_name(xcb_window_t w);
 char*    x_get_command(xcb_window_t w);
+xcb_get_property_cookie_t x_request_text_property(xcb_window_t w, xcb_atom_t a);
+xcb_get_property_cookie_t x_request_pid(xcb_window_t w);
+bool     x_get_pid_reply(xcb_get_property_cookie_t c, uint32_t *pid);
+bool     x_is_local_host(const char *name, size_t len);
+uint32_t x_client_id(xcb_window_t w);
+bool     x_get_text_property_reply(xcb_get_property_cookie_t c,
+                                   xcb_get_text_property_reply_t *reply);
 int32_t  x_get_strwidth(const char *s);
+int32_t  x_get_strnwidth(const char *s, size_t len);
+size_t   x_get_strfit(const char *s, size_t len, int32_t width);
 
 xcb_alloc_color_reply_t*       x_load_color(uint16_t r, uint16_t g, uint16_t b);
 xcb_alloc_named_color_reply_t* x_load_strcolor(const char *name);
 xcb_gcontext_t                 x_load_gc(const char *fg, const char *bg);
+xcb_gcontext_t                 x_create_gc(uint32_t fg, uint32_t bg);
+xcb_visualtype_t*              x_find_visual(xcb_visualid_t id);
+void                           x_request_color(xcolor *c, const char *name);
+void                           x_get_color_reply(xcolor *c);
 
 #endif